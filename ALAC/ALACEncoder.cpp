@@ -39,6 +39,7 @@
 #include "ALACBitUtilities.h"
 #include "ALACAudioTypes.h"
 #include "EndianPortable.h"
+#include "../counters.h"
 
 // Note: in C you can't typecast to a 2-dimensional array pointer but that's what we need when
 // picking which coefs to use so we declare this typedef b/c we *can* typecast to this type
@@ -373,6 +374,7 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
     }
     
     mLastMixRes[channelIndex] = (int16_t)bestRes;
+    HISTOGRAM( "alac.stereo.mixRes", bestRes );
 
 	// mix the stereo inputs with the current best mixRes
 	mixRes = mLastMixRes[channelIndex];
@@ -433,6 +435,8 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 			numV = numUV;
 		}
 	}
+	HISTOGRAM( "alac.stereo.numU", numU );
+	HISTOGRAM( "alac.stereo.numV", numV );
 
 	// test for escape hatch if best calculated compressed size turns out to be more than the input size
 	minBits = minBits1 + minBits2 + (8 /* mixRes/maxRes/etc. */ * 8) + ((partialFrame == true) ? 32 : 0);
@@ -531,6 +535,7 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 
 	if ( doEscape == true )
 	{
+		COUNTER_INC( "alac.stereo.escape" );
 		/* escape */
 		status = this->EncodeStereoEscape( bitstream, inputBuffer, stride, numSamples );
 
@@ -711,6 +716,7 @@ int32_t ALACEncoder::EncodeStereoFast( BitBuffer * bitstream, void * inputBuffer
 
 	if ( doEscape == true )
 	{
+		COUNTER_INC( "alac.stereo.escape" );
 		/* escape */
 
 		// reset bitstream position since we speculatively wrote the compressed version
@@ -940,6 +946,7 @@ int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint
 		
 		// write the params and predictor coefs
 		numU = bestU;
+		HISTOGRAM( "alac.mono.numU", numU );
 		BitBufferWrite( bitstream, (0 << 4) | DENSHIFT_DEFAULT, 8 );	// modeU = 0
 		BitBufferWrite( bitstream, (pbFactor << 5) | numU, 8 );
 		for ( index = 0; index < numU; index++ )
@@ -977,6 +984,7 @@ int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint
 
 	if ( doEscape == true )
 	{
+		COUNTER_INC( "alac.mono.escape" );
 		// write bitstream header and coefs
 		BitBufferWrite( bitstream, 0, 12 );
 		BitBufferWrite( bitstream, (partialFrame << 3) | 1, 4 );	// LSB = 1 means "frame not compressed"
@@ -1038,6 +1046,8 @@ int32_t ALACEncoder::Encode(AudioFormatDescription theInputFormat, AudioFormatDe
 
 	// create a bit buffer structure pointing to our output buffer
 	BitBufferInit( &bitstream, theWriteBuffer, mMaxOutputBytes );
+	TRACE_SPAN( "alac.Encode" );
+	COUNTER_INC( "alac.packets" );
 
 	if ( theInputFormat.mChannelsPerFrame == 2 )
 	{
@@ -1,4 +1,5 @@
 #include "CoreAudioEncoder.h"
+#include "counters.h"
 
 CoreAudioEncoder::CoreAudioEncoder(AudioConverterX &converter)
     : m_converter(converter),
@@ -27,6 +28,7 @@ CoreAudioEncoder::CoreAudioEncoder(AudioConverterX &converter)
 
 uint32_t CoreAudioEncoder::encodeChunk(UInt32 npackets)
 {
+    TRACE_SPAN("coreaudio.encodeChunk");
     prepareOutputBuffer(npackets);
     AudioBufferList *abl = m_output_abl.get();
     AudioStreamPacketDescription *aspd = &m_packet_desc[0];
@@ -50,7 +50,13 @@ public:
 
     void seekTo(int64_t count)
     {
-        m_src->seekTo(m_start + count);
+        /*
+         * Tracks of a cue sheet are read one after another from the same
+         * source; next track usually starts where the previous one ended.
+         */
+        int64_t pos = m_start + count;
+        if (m_src->getPosition() != pos)
+            m_src->seekTo(pos);
         m_position = count;
     }
 
@@ -9,6 +9,7 @@
 #include "mp4v2wrapper.h"
 #include "strutil.h"
 #include "itunetags.h"
+#include "mp4probe.h"
 
 typedef std::shared_ptr<const __CFDictionary> CFDictionaryPtr;
 
@@ -182,15 +183,24 @@ ExtAFSource::ExtAFSource(const std::shared_ptr<FILE> &fp)
     else if (fcc == kAudioFileMP3Type)
         ID3::fetchMPEGID3Tags(fileno(m_fp.get()), &m_tags);
     else if (fcc == 'm4af' || fcc == 'm4bf' || fcc == 'mp4f') {
+        /*
+         * Tags come from the header-only probe, which never loads covr.
+         * The whole atom tree is read only when there are chapters.
+         */
         try {
             int fd = fileno(m_fp.get());
-            util::FilePositionSaver _(fd);
-            static MP4FDReadProvider provider;
-            MP4FileX file;
-            std::string name = strutil::format("%d", fd);
-            file.Read(name.c_str(), &provider);
-            mp4a::fetchTags(file, &m_tags);
-            file.GetChapters(&m_chapters);
+            mp4a::ProbeInfo info;
+            if (mp4a::probe(fd, &info)) {
+                m_tags.swap(info.shortTags);
+                if (info.has_chapters) {
+                    util::FilePositionSaver _(fd);
+                    static MP4FDReadProvider provider;
+                    MP4FileX file;
+                    std::string name = strutil::format("%d", fd);
+                    file.Read(name.c_str(), &provider);
+                    file.GetChapters(&m_chapters);
+                }
+            }
         } catch (...) {}
     } else {
         try {
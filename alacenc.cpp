@@ -1,8 +1,12 @@
+#include <ALACBitUtilities.h>
 #include "alacenc.h"
 #include "cautil.h"
+#include "strutil.h"
+#include "counters.h"
 
 ALACEncoderX::ALACEncoderX(const AudioStreamBasicDescription &desc)
-    : m_encoder(new ALACEncoder()), m_iasbd(desc)
+    : m_encoder(new ALACEncoder()), m_iasbd(desc),
+      m_digest(util::FNV1A_INIT)
 {
     std::memcpy(&m_iafd, &desc, sizeof desc);
     m_iafd.mBytesPerFrame =
@@ -41,6 +45,7 @@ ALACEncoderX::ALACEncoderX(const AudioStreamBasicDescription &desc)
 
 uint32_t ALACEncoderX::encodeChunk(UInt32 npackets)
 {
+    TRACE_SPAN("alac.encodeChunk");
     const AudioStreamBasicDescription &asbd = getInputDescription();
     uint32_t n = 0, nread = 0;
     size_t nsamples = 0;
@@ -67,12 +72,47 @@ uint32_t ALACEncoderX::encodeChunk(UInt32 npackets)
         int xbytes = nbytes;
         m_encoder->Encode(m_iafd, m_odesc.afd, &m_input_buffer[0],
                           &m_output_buffer[0], &xbytes);
+        if (m_decoder.get())
+            verify(nbytes, xbytes);
         m_sink->writeSamples(&m_output_buffer[0], xbytes, nsamples);
         m_stat.updateWritten(nsamples, xbytes);
     }
     return n;
 }
 
+void ALACEncoderX::setVerify(bool verify)
+{
+    if (!verify) {
+        m_decoder.reset();
+        return;
+    }
+    std::vector<uint8_t> cookie;
+    getMagicCookie(&cookie);
+    m_decoder = std::make_shared<ALACDecoder>();
+    CHECKCA(m_decoder->Init(&cookie[0], cookie.size()));
+    m_decode_buffer.resize(m_iafd.mBytesPerFrame *
+                           kALACDefaultFramesPerPacket);
+}
+
+void ALACEncoderX::verify(size_t nbytes, int xbytes)
+{
+    uint32_t size = xbytes;
+    util::fnv1a(&m_digest, &size, 4);
+    util::fnv1a(&m_digest, &m_output_buffer[0], xbytes);
+
+    BitBuffer bits;
+    BitBufferInit(&bits, &m_output_buffer[0], xbytes);
+    uint32_t ncount;
+    CHECKCA(m_decoder->Decode(&bits, &m_decode_buffer[0],
+                              kALACDefaultFramesPerPacket,
+                              m_iafd.mChannelsPerFrame, &ncount));
+    if (ncount * m_iafd.mBytesPerFrame != nbytes ||
+        std::memcmp(&m_decode_buffer[0], &m_input_buffer[0], nbytes))
+        throw std::runtime_error(strutil::format(
+                "ALAC: verification failed in the packet at sample %llu",
+                m_stat.samplesWritten()));
+}
+
 void ALACEncoderX::getMagicCookie(std::vector<uint8_t> *cookie)
 {
     uint32_t size =
@@ -5,6 +5,7 @@
 #include "iencoder.h"
 #include <stdint.h>
 #include <ALACEncoder.h>
+#include <ALACDecoder.h>
 
 class ALACEncoderX: public IEncoder, public IEncoderStat {
     union ASBD {
@@ -20,9 +21,20 @@ class ALACEncoderX: public IEncoder, public IEncoderStat {
     AudioFormatDescription m_iafd;
     ASBD m_odesc;
     EncoderStat m_stat;
+    /* for verification */
+    std::shared_ptr<ALACDecoder> m_decoder;
+    std::vector<uint8_t> m_decode_buffer;
+    uint64_t m_digest;
 public:
     ALACEncoderX(const AudioStreamBasicDescription &desc);
     void setFastMode(bool fast) { m_encoder->SetFastMode(fast); }
+    /*
+     * Decodes every packet right after encoding and compares it with the
+     * input; throws on mismatch.
+     */
+    void setVerify(bool verify);
+    /* FNV-1a hash of the packets encoded so far, when verifying */
+    uint64_t digest() const { return m_digest; }
     uint32_t encodeChunk(UInt32 npackets);
     void getMagicCookie(std::vector<uint8_t> *cookie);
     void setSource(const std::shared_ptr<ISource> &source) { m_src = source; }
@@ -41,6 +53,8 @@ public:
     uint64_t framesWritten() const { return m_stat.framesWritten(); }
     double currentBitrate() const { return m_stat.currentBitrate(); }
     double overallBitrate() const { return m_stat.overallBitrate(); }
+private:
+    void verify(size_t nbytes, int xbytes);
 };
 
 #endif
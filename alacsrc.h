@@ -4,6 +4,7 @@
 
 class ALACSource: public ISeekableSource, public ITagParser
 {
+    bool m_loaded;
     uint32_t m_track_id;
     uint64_t m_length;
     int64_t m_position;
@@ -39,4 +40,6 @@ public:
     {
         return m_chapters.size() ? &m_chapters : 0;
     }
+private:
+    void loadFile();
 };
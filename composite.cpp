@@ -1,4 +1,6 @@
+#include <algorithm>
 #include "composite.h"
+#include "readahead.h"
 
 size_t CompositeSource::readSamples(void *buffer, size_t nsamples)
 {
@@ -10,27 +12,29 @@ size_t CompositeSource::readSamples(void *buffer, size_t nsamples)
         return rc;
     } else {
         ++m_cur_file;
-        if (m_cur_file < m_sources.size())
+        if (m_cur_file < m_sources.size()) {
             m_sources[m_cur_file]->seekTo(0);
+            primeNext();
+        }
         return readSamples(buffer, nsamples);
     }
 }
 
 void CompositeSource::seekTo(int64_t pos)
 {
-    uint64_t acc = 0;
-    for (m_cur_file = 0; m_cur_file < m_sources.size(); ++m_cur_file) {
-        uint64_t len = m_sources[m_cur_file]->length();
-        if (acc <= pos && pos < acc + len)
-            break;
-        acc += len;
-    }
-    if (m_cur_file == m_sources.size())
+    /*
+     * Later sources are not touched here; they are rewound when
+     * readSamples() reaches them.
+     */
+    if (pos < 0 || static_cast<uint64_t>(pos) >= m_length)
         throw std::runtime_error("Invalid seek offset");
-    for (uint32_t i = m_cur_file + 1; i < m_sources.size(); ++i)
-        m_sources[i]->seekTo(0);
-    m_sources[m_cur_file]->seekTo(pos - acc);
+    std::vector<uint64_t>::iterator it =
+        std::upper_bound(m_offsets.begin(), m_offsets.end(),
+                         static_cast<uint64_t>(pos));
+    m_cur_file = static_cast<int32_t>(it - m_offsets.begin()) - 1;
+    m_sources[m_cur_file]->seekTo(pos - m_offsets[m_cur_file]);
     m_position = pos;
+    primeNext();
 }
 
 void CompositeSource::addSource(const std::shared_ptr<ISeekableSource> &src)
@@ -41,6 +45,7 @@ void CompositeSource::addSource(const std::shared_ptr<ISeekableSource> &src)
         throw std::runtime_error("Concatenation of multiple inputs with "
                                  "different sample format is not supported");
     m_sources.push_back(src);
+    m_offsets.push_back(m_length);
     uint64_t len = src->length();
     if (len != ~0ULL && m_length != ~0ULL)
         m_length += src->length();
@@ -74,6 +79,22 @@ void CompositeSource::addSourceWithChapter(
     addChapter(title, src->length() / m_asbd.mSampleRate);
 }
 
+/*
+ * Let the next source start decoding in background while the current one
+ * is being consumed (only when it's a ReadAheadSource).
+ */
+void CompositeSource::primeNext()
+{
+    if (m_cur_file + 1 < m_sources.size()) {
+        ReadAheadSource *ra =
+            dynamic_cast<ReadAheadSource*>(m_sources[m_cur_file + 1].get());
+        if (ra) {
+            ra->seekTo(0);
+            ra->prime();
+        }
+    }
+}
+
 void CompositeSource::fetchAlbumTags(ITagParser *parser)
 {
     const std::map<uint32_t, std::wstring> &tags = parser->getTags();
@@ -10,6 +10,7 @@ class CompositeSource: public ISeekableSource, public ITagParser {
     int64_t m_position;
     uint64_t m_length;
     std::vector<source_t> m_sources;
+    std::vector<uint64_t> m_offsets; // start position of each source
     std::map<uint32_t, std::wstring> m_tags;
     std::vector<chapters::entry_t> m_chapters;
     AudioStreamBasicDescription m_asbd;
@@ -67,6 +68,7 @@ private:
         m_chapters.push_back(std::make_pair(title, length));
     }
     void fetchAlbumTags(ITagParser *parser);
+    void primeNext();
 };
 
 #endif
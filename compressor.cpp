@@ -1,5 +1,6 @@
 #include "compressor.h"
 #include "cautil.h"
+#include "counters.h"
 
 namespace {
     template <typename T>
@@ -41,6 +42,7 @@ Compressor::Compressor(const std::shared_ptr<ISource> &src,
 
 size_t Compressor::readSamples(void *buffer, size_t nsamples)
 {
+    TRACE_SPAN("compressor.readSamples");
     if (m_asbd.mBitsPerChannel == 64)
         return readSamplesT(static_cast<double*>(buffer), nsamples);
     else
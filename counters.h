@@ -0,0 +1,211 @@
+#ifndef _COUNTERS_H
+#define _COUNTERS_H
+
+/*
+ * Hot path counters, histograms and trace spans.
+ * Compiled in only when QAAC_COUNTERS is defined (build with
+ * /p:QaacCounters=true); otherwise the macros expand to nothing.
+ *
+ *   COUNTER_INC(name) / COUNTER_ADD(name, n)
+ *   HISTOGRAM(name, value)       linear bins, 0..63 (larger is clamped)
+ *   HISTOGRAM_LOG2(name, value)  bins by bit length of value
+ *   TRACE_SPAN(name)             records the enclosing scope as a span
+ *
+ * name must be a string literal.
+ */
+#ifdef QAAC_COUNTERS
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "win32util.h"
+
+namespace counters {
+    enum { NBINS = 64 };
+
+    /*
+     * Aggregate, so that the function-local statics in the macros are
+     * initialized statically (VS2010 has no thread safe local statics).
+     * Registered in the registry on first use.
+     */
+    struct Entry {
+        enum Type { kCounter, kHistogram, kHistogramLog2 };
+        Type type;
+        const char *name;
+        volatile LONG64 bins[NBINS]; /* only bins[0] for a counter */
+        volatile LONG registered;
+        Entry *next;
+    };
+
+    struct Span {
+        const char *name;
+        DWORD tid;
+        uint64_t begin; /* microseconds */
+        uint64_t duration;
+    };
+
+    struct Registry {
+        win32::CriticalSection mutex;
+        Entry *head;
+        std::vector<Span> spans;
+        volatile LONG tracing;
+        LARGE_INTEGER origin, frequency;
+
+        Registry(): head(0), tracing(0)
+        {
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&origin);
+        }
+    };
+
+    /* one instance across all translation units and libraries */
+    template <typename T> struct RegistryHolder { static Registry instance; };
+    template <typename T> Registry RegistryHolder<T>::instance;
+
+    inline Registry &registry() { return RegistryHolder<void>::instance; }
+
+    inline void add(Entry *e, uint64_t value, uint64_t n=1)
+    {
+        if (!e->registered) {
+            Registry &r = registry();
+            win32::Lock lock(r.mutex);
+            if (!e->registered) {
+                e->next = r.head;
+                r.head = e;
+                InterlockedExchange(&e->registered, 1);
+            }
+        }
+        unsigned bin = 0;
+        if (e->type == Entry::kHistogram)
+            bin = value < NBINS ? static_cast<unsigned>(value) : NBINS - 1;
+        else if (e->type == Entry::kHistogramLog2)
+            for (; value && bin < NBINS - 1; value >>= 1)
+                ++bin;
+        InterlockedExchangeAdd64(&e->bins[bin], static_cast<LONG64>(n));
+    }
+
+    inline uint64_t load(volatile LONG64 *p)
+    {
+        return InterlockedCompareExchange64(p, 0, 0);
+    }
+
+    inline bool is_tracing()
+    {
+        return InterlockedCompareExchange(&registry().tracing, 0, 0) != 0;
+    }
+
+    inline uint64_t now()
+    {
+        Registry &r = registry();
+        LARGE_INTEGER t;
+        QueryPerformanceCounter(&t);
+        return (t.QuadPart - r.origin.QuadPart) * 1000000
+             / r.frequency.QuadPart;
+    }
+
+    class ScopedSpan {
+        const char *m_name;
+        uint64_t m_begin;
+        bool m_tracing;
+    public:
+        explicit ScopedSpan(const char *name)
+            : m_name(name), m_begin(0), m_tracing(is_tracing())
+        {
+            if (m_tracing)
+                m_begin = now();
+        }
+        ~ScopedSpan()
+        {
+            if (!m_tracing)
+                return;
+            Span span;
+            span.name = m_name;
+            span.tid = GetCurrentThreadId();
+            span.begin = m_begin;
+            span.duration = now() - m_begin;
+            Registry &r = registry();
+            win32::Lock lock(r.mutex);
+            r.spans.push_back(span);
+        }
+    };
+
+    /* spans are recorded only after this is called */
+    inline void enable_trace()
+    {
+        InterlockedExchange(&registry().tracing, 1);
+    }
+
+    /* human readable dump of all counters and histograms */
+    inline std::string report()
+    {
+        Registry &r = registry();
+        win32::Lock lock(r.mutex);
+        std::string s;
+        char buf[128];
+        for (Entry *e = r.head; e; e = e->next) {
+            if (e->type == Entry::kCounter) {
+                std::sprintf(buf, "%-40s %llu\n", e->name,
+                             load(&e->bins[0]));
+                s += buf;
+                continue;
+            }
+            s += e->name;
+            s += e->type == Entry::kHistogram ? ":\n" : " (bit length):\n";
+            for (unsigned i = 0; i < NBINS; ++i) {
+                uint64_t n = load(&e->bins[i]);
+                if (!n) continue;
+                std::sprintf(buf, "  %2u%s %llu\n", i,
+                             i == NBINS - 1 ? "+" : " ", n);
+                s += buf;
+            }
+        }
+        return s;
+    }
+
+    /* Chrome trace event format; loadable by chrome://tracing, Perfetto */
+    inline bool write_trace(FILE *fp)
+    {
+        Registry &r = registry();
+        win32::Lock lock(r.mutex);
+        std::fputs("{\"traceEvents\":[\n", fp);
+        for (size_t i = 0; i < r.spans.size(); ++i) {
+            const Span &span = r.spans[i];
+            std::fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                         "\"tid\":%lu,\"ts\":%llu,\"dur\":%llu}",
+                         i ? ",\n" : "", span.name, span.tid,
+                         span.begin, span.duration);
+        }
+        std::fputs("\n]}\n", fp);
+        return std::ferror(fp) == 0;
+    }
+}
+
+#define COUNTERS_CAT_(a, b) a##b
+#define COUNTERS_CAT(a, b) COUNTERS_CAT_(a, b)
+
+#define COUNTERS_ENTRY_(type, name, value, n) \
+    do { \
+        static counters::Entry entry_ = { counters::Entry::type, name }; \
+        counters::add(&entry_, value, n); \
+    } while (0)
+
+#define COUNTER_ADD(name, n) COUNTERS_ENTRY_(kCounter, name, 0, n)
+#define COUNTER_INC(name) COUNTER_ADD(name, 1)
+#define HISTOGRAM(name, value) COUNTERS_ENTRY_(kHistogram, name, value, 1)
+#define HISTOGRAM_LOG2(name, value) \
+    COUNTERS_ENTRY_(kHistogramLog2, name, value, 1)
+#define TRACE_SPAN(name) \
+    counters::ScopedSpan COUNTERS_CAT(span_, __LINE__)(name)
+
+#else
+
+#define COUNTER_ADD(name, n) do {} while (0)
+#define COUNTER_INC(name) do {} while (0)
+#define HISTOGRAM(name, value) do {} while (0)
+#define HISTOGRAM_LOG2(name, value) do {} while (0)
+#define TRACE_SPAN(name) do {} while (0)
+
+#endif
+
+#endif
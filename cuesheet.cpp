@@ -9,6 +9,7 @@
 #include "expand.h"
 #include "inputfactory.h"
 #include "playlist.h"
+#include "readahead.h"
 
 static inline
 unsigned msf2frames(unsigned mm, unsigned ss, unsigned ff)
@@ -167,9 +168,11 @@ void CueSheet::parse(std::wstreambuf *src)
 
 void CueSheet::loadTracks(playlist::Playlist &tracks,
                           const std::wstring &cuedir,
-                          const std::wstring &fname_format)
+                          const std::wstring &fname_format,
+                          size_t read_ahead)
 {
     std::shared_ptr<ISeekableSource> src;
+    std::map<std::wstring, std::shared_ptr<ISeekableSource> > files;
     for (const_iterator track = begin(); track != end(); ++track) {
         std::shared_ptr<CompositeSource> track_source(new CompositeSource());
         std::map<uint32_t, std::wstring> track_tags;
@@ -184,7 +187,14 @@ void CueSheet::loadTracks(playlist::Playlist &tracks,
             } else {
                 std::wstring ifilename =
                     win32::PathCombineX(cuedir, segment->m_filename);
-                src = input::factory()->open(ifilename.c_str());
+                std::shared_ptr<ISeekableSource> &file = files[ifilename];
+                if (!file.get()) {
+                    file = input::factory()->open(ifilename.c_str());
+                    if (read_ahead)
+                        file = std::make_shared<ReadAheadSource>(file,
+                                                                 read_ahead);
+                }
+                src = file;
             }
             double rate = src->getSampleFormat().mSampleRate;
             uint64_t begin = frame2sample(rate, segment->m_begin);
@@ -86,9 +86,15 @@ public:
 
     CueSheet(): m_has_multiple_files(false) {}
     void parse(std::wstreambuf *src);
+    /*
+     * read_ahead: when nonzero, decode each FILE on a separate thread in
+     * blocks of this many frames, shared by all the tracks in it, so that
+     * an image is decoded once sequentially.
+     */
     void loadTracks(playlist::Playlist &tracks,
                     const std::wstring &cuedir,
-                    const std::wstring &fname_format);
+                    const std::wstring &fname_format,
+                    size_t read_ahead=0);
     void asChapters(double duration, /* total duration in sec. */
                     std::vector<chapters::entry_t> *chapters) const;
     const std::map<std::wstring, std::wstring> &getTags() const
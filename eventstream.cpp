@@ -0,0 +1,183 @@
+#include "eventstream.h"
+#include "strutil.h"
+
+EventStream *EventStream::m_instance = 0;
+
+namespace {
+    uint64_t unix_time_ms()
+    {
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft);
+        uint64_t t = (static_cast<uint64_t>(ft.dwHighDateTime) << 32)
+                   | ft.dwLowDateTime;
+        return (t - 116444736000000000ULL) / 10000;
+    }
+
+    std::string quote(const std::wstring &s)
+    {
+        return "\"" + strutil::w2us(strutil::json_escape(s)) + "\"";
+    }
+
+    std::string number(uint64_t n)
+    {
+        return n == ~0ULL ? "null" : strutil::format("%llu", n);
+    }
+}
+
+void EventStream::open(const wchar_t *target)
+{
+    FILE *fp;
+    wchar_t *end;
+    long fd = std::wcstol(target, &end, 10);
+    if (*target && !*end) {
+        _setmode(fd, _O_BINARY);
+        CHECKCRT((fp = _fdopen(fd, "wb")) == 0);
+    } else if (std::wcsstr(target, L"\\\\.\\pipe\\") == target) {
+        int pipe = win32::create_named_pipe(target);
+        CHECKCRT((fp = _fdopen(pipe, "wb")) == 0);
+    } else {
+        fp = win32::wfopenx(target, L"wb");
+    }
+    m_fp.reset(fp, std::fclose);
+    m_event = win32::create_event();
+    intptr_t h = _beginthreadex(0, 0, staticWriterThreadProc, this, 0, 0);
+    if (h == -1) {
+        m_fp.reset();
+        throw std::runtime_error(std::strerror(errno));
+    }
+    m_thread.reset(reinterpret_cast<HANDLE>(h), CloseHandle);
+}
+
+void EventStream::close()
+{
+    if (!m_thread.get())
+        return;
+    {
+        win32::Lock lock(m_mutex);
+        m_stop = true;
+    }
+    SetEvent(m_event.get());
+    WaitForSingleObject(m_thread.get(), INFINITE);
+    m_thread.reset();
+    m_fp.reset();
+}
+
+void EventStream::start(const std::wstring &output, const std::wstring &title)
+{
+    Event ev;
+    ev.type = Event::kStart;
+    ev.text[0] = output;
+    ev.text[1] = title;
+    post(ev);
+}
+
+void EventStream::progress(const char *phase, uint64_t position,
+                           uint64_t total, double speed, double bitrate)
+{
+    Event ev;
+    ev.type = Event::kProgress;
+    ev.phase = phase;
+    ev.position = position;
+    ev.total = total;
+    ev.speed = speed;
+    ev.bitrate = bitrate;
+    post(ev);
+}
+
+void EventStream::end(const char *phase, uint64_t position, uint64_t total,
+                      double speed, double bitrate)
+{
+    Event ev;
+    ev.type = Event::kEnd;
+    ev.phase = phase;
+    ev.position = position;
+    ev.total = total;
+    ev.speed = speed;
+    ev.bitrate = bitrate;
+    post(ev);
+}
+
+void EventStream::peak(double value)
+{
+    Event ev;
+    ev.type = Event::kPeak;
+    ev.value = value;
+    post(ev);
+}
+
+void EventStream::error(const std::wstring &message)
+{
+    Event ev;
+    ev.type = Event::kError;
+    ev.text[0] = message;
+    post(ev);
+}
+
+void EventStream::post(Event &ev)
+{
+    if (!m_thread.get())
+        return;
+    ev.time = unix_time_ms();
+    {
+        win32::Lock lock(m_mutex);
+        m_queue.push_back(ev);
+    }
+    SetEvent(m_event.get());
+}
+
+std::string EventStream::format(const Event &ev)
+{
+    std::string s = strutil::format("{\"time\":%llu,", ev.time);
+    switch (ev.type) {
+    case Event::kStart:
+        s += "\"event\":\"start\",\"output\":" + quote(ev.text[0])
+           + ",\"title\":" + quote(ev.text[1]);
+        break;
+    case Event::kProgress:
+    case Event::kEnd:
+        s += strutil::format("\"event\":\"%s\",\"phase\":\"%s\"",
+                             ev.type == Event::kEnd ? "end" : "progress",
+                             ev.phase);
+        s += ",\"position\":" + number(ev.position)
+           + ",\"total\":" + number(ev.total);
+        if (ev.total != ~0ULL && ev.total)
+            s += strutil::format(",\"percent\":%.2f",
+                                 100.0 * ev.position / ev.total);
+        s += strutil::format(",\"speed\":%.3f", ev.speed);
+        if (ev.bitrate > 0.0)
+            s += strutil::format(",\"bitrate\":%.3f", ev.bitrate);
+        break;
+    case Event::kPeak:
+        s += strutil::format("\"event\":\"peak\",\"value\":%g", ev.value);
+        if (ev.value > 0.0)
+            s += strutil::format(",\"dB\":%.3f",
+                                 util::scale_to_dB(ev.value));
+        break;
+    case Event::kError:
+        s += "\"event\":\"error\",\"message\":" + quote(ev.text[0]);
+        break;
+    }
+    return s + "}\n";
+}
+
+void EventStream::writerThreadProc()
+{
+    for (;;) {
+        std::deque<Event> events;
+        bool stop;
+        {
+            win32::Lock lock(m_mutex);
+            events.swap(m_queue);
+            stop = m_stop;
+        }
+        for (size_t i = 0; i < events.size(); ++i) {
+            std::string s = format(events[i]);
+            std::fwrite(s.c_str(), 1, s.size(), m_fp.get());
+        }
+        if (events.size())
+            std::fflush(m_fp.get());
+        if (stop)
+            break;
+        WaitForSingleObject(m_event.get(), INFINITE);
+    }
+}
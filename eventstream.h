@@ -0,0 +1,70 @@
+#ifndef _EVENTSTREAM_H
+#define _EVENTSTREAM_H
+
+#include <deque>
+#include <process.h>
+#include "win32util.h"
+
+/*
+ * Machine readable progress events (--progress-json), one JSON object
+ * per line. Callers only queue raw values; formatting and writing is done
+ * by a writer thread.
+ */
+class EventStream {
+    struct Event {
+        enum { kStart, kProgress, kEnd, kPeak, kError } type;
+        uint64_t time; /* milliseconds since the UNIX epoch */
+        const char *phase;
+        std::wstring text[2];
+        uint64_t position, total;
+        double speed, bitrate, value;
+
+        Event()
+            : phase(""), position(0), total(0), speed(0.0), bitrate(0.0),
+              value(0.0)
+        {}
+    };
+    std::shared_ptr<FILE> m_fp;
+    std::deque<Event> m_queue;
+    uint32_t m_interval;
+    bool m_stop;
+    win32::CriticalSection m_mutex;
+    std::shared_ptr<void> m_event, m_thread;
+    static EventStream *m_instance;
+public:
+    static EventStream *instance()
+    {
+        if (!m_instance) m_instance = new EventStream();
+        return m_instance;
+    }
+    ~EventStream() { close(); }
+
+    /* target: file descriptor number, \\.\pipe\name, or filename */
+    void open(const wchar_t *target);
+    void close();
+    bool is_enabled() { return m_fp.get() != 0; }
+    /* minimum interval of progress events in milliseconds */
+    uint32_t interval() const { return m_interval; }
+    void setInterval(uint32_t ms) { m_interval = ms; }
+
+    void start(const std::wstring &output, const std::wstring &title);
+    void progress(const char *phase, uint64_t position, uint64_t total,
+                  double speed, double bitrate);
+    void end(const char *phase, uint64_t position, uint64_t total,
+             double speed, double bitrate);
+    void peak(double value);
+    void error(const std::wstring &message);
+private:
+    EventStream(): m_interval(1000), m_stop(false) {}
+    void post(Event &ev);
+    std::string format(const Event &ev);
+    void writerThreadProc();
+    static unsigned __stdcall staticWriterThreadProc(void *arg)
+    {
+        EventStream *self = static_cast<EventStream*>(arg);
+        self->writerThreadProc();
+        return 0;
+    }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include <functional>
+#include <emmintrin.h>
 #include "flacsrc.h"
 #include "strutil.h"
 #include "itunetags.h"
@@ -25,6 +26,81 @@ namespace flac {
         want(si.channels > 0 && si.channels < 9);
         want(si.bits_per_sample >= 8 && si.bits_per_sample <= 32);
     }
+
+    /*
+     * Interleave libFLAC's planar output, shifting samples to MSB side.
+     */
+    void interleave(const FLAC__int32 * const *src, unsigned nchannels,
+                    unsigned shifts, size_t nframes, int32_t *dst)
+    {
+        size_t i = 0;
+        __m128i count = _mm_cvtsi32_si128(shifts);
+        if (nchannels == 2) {
+            const FLAC__int32 *lp = src[0], *rp = src[1];
+            for (; i + 4 <= nframes; i += 4) {
+                __m128i l = _mm_loadu_si128((const __m128i*)(lp + i));
+                __m128i r = _mm_loadu_si128((const __m128i*)(rp + i));
+                l = _mm_sll_epi32(l, count);
+                r = _mm_sll_epi32(r, count);
+                _mm_storeu_si128((__m128i*)(dst + 2 * i),
+                                 _mm_unpacklo_epi32(l, r));
+                _mm_storeu_si128((__m128i*)(dst + 2 * i + 4),
+                                 _mm_unpackhi_epi32(l, r));
+            }
+            for (; i < nframes; ++i) {
+                dst[2 * i] = lp[i] << shifts;
+                dst[2 * i + 1] = rp[i] << shifts;
+            }
+        } else if (nchannels == 1) {
+            const FLAC__int32 *p = src[0];
+            for (; i + 4 <= nframes; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+                _mm_storeu_si128((__m128i*)(dst + i), _mm_sll_epi32(v, count));
+            }
+            for (; i < nframes; ++i)
+                dst[i] = p[i] << shifts;
+        } else {
+            for (unsigned n = 0; n < nchannels; ++n) {
+                const FLAC__int32 *p = src[n];
+                int32_t *bp = dst + n;
+                for (i = 0; i < nframes; ++i, bp += nchannels)
+                    *bp = p[i] << shifts;
+            }
+        }
+    }
+    void parseVorbisComments(const std::vector<std::string> &comments,
+                             double duration,
+                             std::map<uint32_t, std::wstring> *tags,
+                             std::vector<chapters::entry_t> *chapters,
+                             std::vector<uint32_t> *chanmap)
+    {
+        std::map<std::string, std::string> vorbisComments;
+        std::wstring cuesheet;
+        for (size_t i = 0; i < comments.size(); ++i) {
+            strutil::Tokenizer<char> tokens(comments[i].c_str(), "=");
+            char *key = tokens.next();
+            char *value = tokens.rest();
+            if (strcasecmp(key, "waveformatextensible_channel_mask") == 0) {
+                unsigned mask = 0;
+                if (sscanf(value, "%i", &mask) == 1)
+                    chanmap::getChannels(mask, chanmap);
+            } else if (value) {
+                vorbisComments[key] = value;
+                if (!strcasecmp(key, "cuesheet"))
+                    cuesheet = strutil::us2w(value);
+                else
+                    vorbisComments[key] = value;
+            }
+        }
+        Vorbis::ConvertToItunesTags(vorbisComments, tags);
+        if (cuesheet.size()) {
+            std::map<uint32_t, std::wstring> cuetags;
+            Cue::CueSheetToChapters(cuesheet, duration, chapters, &cuetags);
+            std::map<uint32_t, std::wstring>::const_iterator it;
+            for (it = cuetags.begin(); it != cuetags.end(); ++it)
+                (*tags)[it->first] = it->second;
+        }
+    }
 }
 #define TRYFL(expr) (void)(flac::try__((expr), #expr))
 
@@ -33,8 +109,13 @@ FLACSource::FLACSource(const FLACModule &module,
     m_eof(false),
     m_giveup(false),
     m_initialize_done(false),
+    m_is_ogg(false),
     m_length(0),
     m_position(0),
+    m_dest(0),
+    m_dest_capacity(0),
+    m_readpos(0),
+    m_readend(0),
     m_fp(fp),
     m_module(module)
 {
@@ -53,6 +134,7 @@ FLACSource::FLACSource(const FLACModule &module,
     if ((fcc != 'fLaC' && fcc != 'OggS')
      || (fcc == 'OggS' && std::memcmp(&buffer[28], "\177FLAC", 5)))
         throw std::runtime_error("Not a FLAC file");
+    m_is_ogg = (fcc == 'OggS');
     CHECKCRT(_lseeki64(fileno(m_fp.get()), 0, SEEK_SET) < 0);
 
     m_decoder =
@@ -86,6 +168,7 @@ void FLACSource::seekTo(int64_t count)
     if (count == m_position)
         return;
     m_buffer.reset();
+    m_dest = 0;
     TRYFL(m_module.stream_decoder_seek_absolute(m_decoder.get(), count));
     m_position = count;
 }
@@ -94,31 +177,59 @@ size_t FLACSource::readSamples(void *buffer, size_t nsamples)
 {
     if (m_giveup)
         throw std::runtime_error("FLAC decoder error");
-    if (!m_buffer.count()) {
-        if (m_module.stream_decoder_get_state(m_decoder.get()) ==
-                FLAC__STREAM_DECODER_END_OF_STREAM)
-            return 0;
+    uint32_t nchannels = m_asbd.mChannelsPerFrame;
+    int32_t *bp = static_cast<int32_t*>(buffer);
+    size_t done = 0;
+    /* leftover of the last frame, which didn't fit */
+    if (m_buffer.count()) {
+        done = std::min(static_cast<size_t>(m_buffer.count()), nsamples);
+        std::memcpy(bp, m_buffer.read_ptr(), done * nchannels * 4);
+        m_buffer.advance(done);
+    }
+    /*
+     * Decode as many frames as possible directly into the caller's buffer.
+     * The frame that doesn't fit goes to m_buffer.
+     */
+    m_dest = bp + done * nchannels;
+    m_dest_capacity = nsamples - done;
+    while (m_dest_capacity && !m_buffer.count() &&
+           m_module.stream_decoder_get_state(m_decoder.get()) !=
+               FLAC__STREAM_DECODER_END_OF_STREAM)
+    {
         TRYFL(m_module.stream_decoder_process_single(m_decoder.get()));
     }
-    uint32_t count = std::min(static_cast<size_t>(m_buffer.count()),
-                              nsamples);
-    if (count) {
-        uint32_t bytes = count * m_asbd.mChannelsPerFrame * 4;
-        std::memcpy(buffer, m_buffer.read_ptr(), bytes);
+    done = nsamples - m_dest_capacity;
+    m_dest = 0;
+    if (done < nsamples && m_buffer.count()) {
+        size_t count = std::min(static_cast<size_t>(m_buffer.count()),
+                                nsamples - done);
+        std::memcpy(bp + done * nchannels, m_buffer.read_ptr(),
+                    count * nchannels * 4);
         m_buffer.advance(count);
-        m_position += count;
+        done += count;
     }
-    return count;
+    m_position += done;
+    return done;
 }
 
 FLAC__StreamDecoderReadStatus
 FLACSource::readCallback(FLAC__byte *buffer, size_t *bytes)
 {
-    ssize_t n = util::nread(fileno(m_fp.get()), buffer, *bytes);
-    if (n <= 0) {
-        m_eof = true;
-        return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+    if (m_readpos == m_readend) {
+        if (m_readbuf.empty())
+            m_readbuf.resize(0x40000);
+        ssize_t n = util::nread(fileno(m_fp.get()), &m_readbuf[0],
+                                m_readbuf.size());
+        m_readpos = m_readend = 0;
+        if (n <= 0) {
+            m_eof = true;
+            return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+        }
+        m_readend = n;
     }
+    size_t n = std::min(*bytes, m_readend - m_readpos);
+    std::memcpy(buffer, &m_readbuf[m_readpos], n);
+    m_readpos += n;
     *bytes = n;
     return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
 }
@@ -127,6 +238,15 @@ FLAC__StreamDecoderSeekStatus
 FLACSource::seekCallback(uint64_t offset)
 {
     m_eof = false;
+    /* stay in the read-ahead buffer if possible */
+    int64_t end = _lseeki64(fileno(m_fp.get()), 0, SEEK_CUR);
+    int64_t start = end - m_readend;
+    int64_t off = offset;
+    if (end >= 0 && off >= start && off < end) {
+        m_readpos = static_cast<size_t>(off - start);
+        return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+    }
+    m_readpos = m_readend = 0;
     if (_lseeki64(fileno(m_fp.get()), offset, SEEK_SET) == offset)
         return FLAC__STREAM_DECODER_SEEK_STATUS_OK; 
     else
@@ -139,7 +259,7 @@ FLACSource::tellCallback(uint64_t *offset)
     int64_t off = _lseeki64(fileno(m_fp.get()), 0, SEEK_CUR);
     if (off < 0)
         return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
-    *offset = off;
+    *offset = off - (m_readend - m_readpos);
     return FLAC__STREAM_DECODER_TELL_STATUS_OK;
 }
 
@@ -172,13 +292,18 @@ FLACSource::writeCallback( const FLAC__Frame *frame,
      * FLAC sample is aligned to low. We make it aligned to high by
      * shifting to MSB side.
      */
-    uint32_t shifts = 32 - h.bits_per_sample;
-    m_buffer.resize(h.blocksize);
-    int32_t *bp = m_buffer.write_ptr();
-    for (size_t i = 0; i < h.blocksize; ++i)
-        for (size_t n = 0; n < h.channels; ++n)
-            *bp++ = (buffer[n][i] << shifts);
-    m_buffer.commit(h.blocksize);
+    int32_t *bp;
+    if (m_dest && h.blocksize <= m_dest_capacity) {
+        bp = m_dest;
+        m_dest += h.blocksize * h.channels;
+        m_dest_capacity -= h.blocksize;
+    } else {
+        m_buffer.resize(h.blocksize);
+        m_buffer.commit(h.blocksize);
+        bp = m_buffer.write_ptr();
+    }
+    flac::interleave(buffer, h.channels, 32 - h.bits_per_sample,
+                     h.blocksize, bp);
 
     return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
@@ -215,33 +340,11 @@ void FLACSource::handleStreamInfo(const FLAC__StreamMetadata_StreamInfo &si)
 void FLACSource::handleVorbisComment(
         const FLAC__StreamMetadata_VorbisComment &vc)
 {
-    std::map<std::string, std::string> vorbisComments;
-    std::wstring cuesheet;
+    std::vector<std::string> comments;
     for (size_t i = 0; i < vc.num_comments; ++i) {
         const char *cs = reinterpret_cast<const char *>(vc.comments[i].entry);
-        strutil::Tokenizer<char> tokens(cs, "=");
-        char *key = tokens.next();
-        char *value = tokens.rest();
-        if (strcasecmp(key, "waveformatextensible_channel_mask") == 0) {
-            unsigned mask = 0;
-            if (sscanf(value, "%i", &mask) == 1)
-                chanmap::getChannels(mask, &m_chanmap);
-        } else if (value) {
-            vorbisComments[key] = value;
-            if (!strcasecmp(key, "cuesheet"))
-                cuesheet = strutil::us2w(value);
-            else
-                vorbisComments[key] = value;
-        }
-    }
-    Vorbis::ConvertToItunesTags(vorbisComments, &m_tags);
-    if (cuesheet.size()) {
-        std::map<uint32_t, std::wstring> tags;
-        Cue::CueSheetToChapters(cuesheet,
-                                m_length / m_asbd.mSampleRate,
-                                &m_chapters, &tags);
-        std::map<uint32_t, std::wstring>::const_iterator it;
-        for (it = tags.begin(); it != tags.end(); ++it)
-            m_tags[it->first] = it->second;
+        comments.push_back(cs);
     }
+    flac::parseVorbisComments(comments, m_length / m_asbd.mSampleRate,
+                              &m_tags, &m_chapters, &m_chanmap);
 }
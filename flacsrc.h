@@ -6,12 +6,23 @@
 #include "iointer.h"
 #include "flacmodule.h"
 
+namespace flac {
+    void interleave(const FLAC__int32 * const *src, unsigned nchannels,
+                    unsigned shifts, size_t nframes, int32_t *dst);
+    void parseVorbisComments(const std::vector<std::string> &comments,
+                             double duration,
+                             std::map<uint32_t, std::wstring> *tags,
+                             std::vector<chapters::entry_t> *chapters,
+                             std::vector<uint32_t> *chanmap);
+}
+
 class FLACSource: public ISeekableSource, public ITagParser
 {
     typedef std::shared_ptr<FLAC__StreamDecoder> decoder_t;
     bool m_eof;
     bool m_giveup;
     bool m_initialize_done;
+    bool m_is_ogg;
     decoder_t m_decoder;
     uint64_t m_length;
     int64_t m_position;
@@ -20,6 +31,13 @@ class FLACSource: public ISeekableSource, public ITagParser
     std::map<uint32_t, std::wstring> m_tags;
     std::vector<chapters::entry_t> m_chapters;
     DecodeBuffer<int32_t> m_buffer;
+    /* caller's buffer, frames are decoded directly into here if fit */
+    int32_t *m_dest;
+    size_t m_dest_capacity;
+    /* read-ahead buffer for libFLAC's read callback */
+    std::vector<uint8_t> m_readbuf;
+    size_t m_readpos;
+    size_t m_readend;
     AudioStreamBasicDescription m_asbd;
     FLACModule m_module;
 public:
@@ -37,6 +55,8 @@ public:
     size_t readSamples(void *buffer, size_t nsamples);
     bool isSeekable() { return util::is_seekable(fileno(m_fp.get())); }
     void seekTo(int64_t count);
+    /* Ogg FLAC; seeking is much more expensive than native FLAC */
+    bool isOgg() const { return m_is_ogg; }
     const std::map<uint32_t, std::wstring> &getTags() const { return m_tags; }
     const std::vector<chapters::entry_t> *getChapters() const
     {
@@ -0,0 +1,143 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "util.h"
+#include "imagescale.h"
+
+namespace {
+    /* weights are fixed point with this many fraction bits */
+    const int PRECISION = 14;
+
+    double sinc(double x)
+    {
+        if (x == 0.0)
+            return 1.0;
+        x *= 3.14159265358979323846;
+        return std::sin(x) / x;
+    }
+
+    double lanczos3(double x)
+    {
+        return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+    }
+
+    /*
+     * For each output position, the first input position and taps[]
+     * weights (zero padded after count[i]).
+     */
+    struct Kernel {
+        unsigned taps;
+        std::vector<unsigned> start;
+        std::vector<unsigned> count;
+        std::vector<int32_t> weights;
+
+        Kernel(unsigned insize, unsigned outsize)
+        {
+            double scale = static_cast<double>(insize) / outsize;
+            double fscale = std::max(scale, 1.0);
+            double support = 3.0 * fscale;
+            taps = static_cast<unsigned>(std::ceil(support)) * 2 + 1;
+            start.resize(outsize);
+            count.resize(outsize);
+            weights.assign(outsize * taps, 0);
+
+            std::vector<double> w(taps);
+            for (unsigned i = 0; i < outsize; ++i) {
+                double center = (i + 0.5) * scale;
+                int lo = static_cast<int>(center - support + 0.5);
+                int hi = static_cast<int>(center + support + 0.5);
+                lo = std::max(lo, 0);
+                hi = std::min(hi, static_cast<int>(insize));
+                unsigned n = std::min(static_cast<unsigned>(hi - lo), taps);
+                double sum = 0.0;
+                for (unsigned j = 0; j < n; ++j) {
+                    w[j] = lanczos3((lo + j + 0.5 - center) / fscale);
+                    sum += w[j];
+                }
+                int32_t *wp = &weights[i * taps];
+                for (unsigned j = 0; j < n; ++j)
+                    wp[j] = lrint(w[j] / sum * (1 << PRECISION));
+                start[i] = lo;
+                count[i] = n;
+            }
+        }
+    };
+
+    inline uint8_t clip(int32_t v)
+    {
+        v = (v + (1 << (PRECISION - 1))) >> PRECISION;
+        return v < 0 ? 0 : v > 255 ? 255 : v;
+    }
+
+    template <unsigned N>
+    void hpass(const Kernel &k, const uint8_t *src, uint8_t *dst,
+               unsigned dwidth)
+    {
+        for (unsigned x = 0; x < dwidth; ++x) {
+            const uint8_t *sp = src + k.start[x] * N;
+            const int32_t *wp = &k.weights[x * k.taps];
+            int32_t acc[N] = { 0 };
+            for (unsigned j = 0, n = k.count[x]; j < n; ++j, sp += N)
+                for (unsigned c = 0; c < N; ++c)
+                    acc[c] += sp[c] * wp[j];
+            for (unsigned c = 0; c < N; ++c)
+                *dst++ = clip(acc[c]);
+        }
+    }
+
+    void hpass(const Kernel &k, const uint8_t *src, uint8_t *dst,
+               unsigned dwidth, unsigned channels)
+    {
+        switch (channels) {
+        case 1: hpass<1>(k, src, dst, dwidth); break;
+        case 2: hpass<2>(k, src, dst, dwidth); break;
+        case 3: hpass<3>(k, src, dst, dwidth); break;
+        case 4: hpass<4>(k, src, dst, dwidth); break;
+        }
+    }
+}
+
+namespace imagescale {
+    void resize(const uint8_t *src, unsigned width, unsigned height,
+                size_t stride, unsigned channels,
+                uint8_t *dst, unsigned dwidth, unsigned dheight,
+                size_t dstride)
+    {
+        if (channels < 1 || channels > 4)
+            throw std::runtime_error("imagescale: unsupported pixel format");
+        if (!width || !height || !dwidth || !dheight)
+            return;
+
+        Kernel hk(width, dwidth), vk(height, dheight);
+        size_t rowsize = dwidth * channels;
+
+        /* horizontal pass, only for the rows the vertical pass reads */
+        unsigned ymin = vk.start[0];
+        unsigned ymax = vk.start[dheight - 1] + vk.count[dheight - 1];
+        std::vector<uint8_t> tmp((ymax - ymin) * rowsize);
+        for (unsigned y = ymin; y < ymax; ++y)
+            hpass(hk, src + y * stride, &tmp[(y - ymin) * rowsize],
+                  dwidth, channels);
+
+        /*
+         * vertical pass; row by row so that the inner loop runs over
+         * contiguous memory and can be vectorized by the compiler
+         */
+        std::vector<int32_t> acc(rowsize);
+        for (unsigned y = 0; y < dheight; ++y) {
+            std::fill(acc.begin(), acc.end(), 0);
+            const int32_t *wp = &vk.weights[y * vk.taps];
+            for (unsigned j = 0; j < vk.count[y]; ++j) {
+                const uint8_t *sp = &tmp[(vk.start[y] + j - ymin) * rowsize];
+                int32_t w = wp[j];
+                int32_t *ap = &acc[0];
+                for (size_t i = 0; i < rowsize; ++i)
+                    ap[i] += sp[i] * w;
+            }
+            uint8_t *dp = dst + y * dstride;
+            for (size_t i = 0; i < rowsize; ++i)
+                dp[i] = clip(acc[i]);
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef _IMAGESCALE_H
+#define _IMAGESCALE_H
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace imagescale {
+    /*
+     * Resizes 8bit interleaved pixels (any number of channels) with a
+     * separable Lanczos3 filter. On downscaling the kernel is widened by
+     * the scale factor, so every source pixel contributes (area filter).
+     */
+    void resize(const uint8_t *src, unsigned width, unsigned height,
+                size_t stride, unsigned channels,
+                uint8_t *dst, unsigned dwidth, unsigned dheight,
+                size_t dstride);
+}
+
+#endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "inputfactory.h"
 #include "win32util.h"
 #ifdef QAAC
@@ -6,12 +7,95 @@
 #include "alacsrc.h"
 #endif
 #include "flacsrc.h"
+#include "lazysource.h"
+#include "nflacsrc.h"
+#include "partitioned.h"
 #include "libsndfilesrc.h"
 #include "rawsource.h"
 #include "taksrc.h"
 #include "wavsource.h"
 #include "wvpacksrc.h"
 
+namespace {
+    enum FileFormat {
+        kUnknown, kWave, kFLAC, kWavpack, kTAK, kMPEG4, kCAF, kAIFF, kMPEGAudio
+    };
+
+    FileFormat sniffExtension(const wchar_t *path)
+    {
+        static const struct {
+            const wchar_t *ext;
+            FileFormat format;
+        } table[] = {
+            { L".wav", kWave }, { L".flac", kFLAC }, { L".oga", kFLAC },
+            { L".wv", kWavpack }, { L".tak", kTAK },
+            { L".m4a", kMPEG4 }, { L".mp4", kMPEG4 }, { L".caf", kCAF },
+            { L".aif", kAIFF }, { L".aiff", kAIFF },
+            { L".mp3", kMPEGAudio }, { L".aac", kMPEGAudio },
+        };
+        const wchar_t *ext = PathFindExtensionW(path);
+        for (size_t i = 0; i < sizeof(table)/sizeof(table[0]); ++i)
+            if (!_wcsicmp(ext, table[i].ext))
+                return table[i].format;
+        return kUnknown;
+    }
+
+    /*
+     * Guess the format from the first bytes of the file, and the extension
+     * when the signature is not conclusive.
+     */
+    FileFormat sniff(int fd, const wchar_t *path)
+    {
+        util::FilePositionSaver _(fd);
+        uint8_t buf[4096];
+        if (_lseeki64(fd, 0, SEEK_SET) != 0)
+            return kUnknown;
+        ssize_t n = util::nread(fd, buf, sizeof buf);
+        if (n < 12)
+            return kUnknown;
+        const uint8_t *p = buf;
+        /* ID3v2 tag is sometimes prepended to FLAC or TAK */
+        if (!std::memcmp(p, "ID3", 3)) {
+            int64_t size = ((p[6] & 0x7f) << 21) | ((p[7] & 0x7f) << 14)
+                        | ((p[8] & 0x7f) << 7) | (p[9] & 0x7f);
+            size += (p[5] & 0x10) ? 20 : 10;
+            if (size + 4 > n) {
+                if (_lseeki64(fd, size, SEEK_SET) != size ||
+                    util::nread(fd, buf, 4) != 4)
+                    return kMPEGAudio;
+            } else
+                p += size;
+            if (!std::memcmp(p, "fLaC", 4))
+                return kFLAC;
+            if (!std::memcmp(p, "tBaK", 4))
+                return kTAK;
+            return kMPEGAudio;
+        }
+        if ((!std::memcmp(p, "RIFF", 4) || !std::memcmp(p, "RF64", 4))
+            && !std::memcmp(p + 8, "WAVE", 4))
+            return kWave;
+        if (!std::memcmp(p, "fLaC", 4))
+            return kFLAC;
+        if (!std::memcmp(p, "OggS", 4))
+            return sniffExtension(path) == kFLAC ? kFLAC : kUnknown;
+        if (!std::memcmp(p, "wvpk", 4))
+            return kWavpack;
+        if (!std::memcmp(p, "tBaK", 4))
+            return kTAK;
+        if (!std::memcmp(p + 4, "ftyp", 4))
+            return kMPEG4;
+        if (!std::memcmp(p, "caff", 4))
+            return kCAF;
+        if (!std::memcmp(p, "FORM", 4) &&
+            (!std::memcmp(p + 8, "AIFF", 4) || !std::memcmp(p + 8, "AIFC", 4)))
+            return kAIFF;
+        /* frame sync alone is weak, trust it only with the extension */
+        if (p[0] == 0xff && (p[1] & 0xe0) == 0xe0)
+            return sniffExtension(path) == kMPEGAudio ? kMPEGAudio : kUnknown;
+        return kUnknown;
+    }
+}
+
 namespace input {
     std::shared_ptr<ISeekableSource> InputFactory::open(const wchar_t *path)
     {
@@ -20,46 +104,161 @@ namespace input {
         if (pos != m_sources.end())
             return pos->second;
 
-        std::shared_ptr<FILE> fp(win32::fopen(path, L"rb"));
-        if (m_is_raw) {
-            std::shared_ptr<RawSource> src =
-                std::make_shared<RawSource>(fp, m_raw_format);
-            m_sources[path] = src;
+        std::shared_ptr<ISeekableSource> src = openDecoder(path);
+        /*
+         * For regular files, the decoder goes to the pool of open
+         * sources, and is reopened on read once the pool closed it.
+         */
+        if (std::wcscmp(path, L"-") && src->isSeekable())
+            src = std::make_shared<LazySource>(path, src);
+        m_sources[path] = src;
+        return src;
+    }
+
+    std::shared_ptr<ISeekableSource>
+    InputFactory::openDecoder(const wchar_t *path)
+    {
+        std::shared_ptr<ISeekableSource> src = openSingleDecoder(path);
+        if (m_parallel_decode < 2 || !src->isSeekable())
             return src;
-        }
+        /* formats with cheap, sample accurate seeking */
+        FLACSource *flac = dynamic_cast<FLACSource*>(src.get());
+        if (dynamic_cast<WavpackSource*>(src.get()) ||
+            dynamic_cast<TakSource*>(src.get()) ||
+            dynamic_cast<NativeFLACSource*>(src.get()) ||
+            (flac && !flac->isOgg()))
+            src = std::make_shared<PartitionedSource>(path, src,
+                                                      m_parallel_decode,
+                                                      m_block_samples);
+        return src;
+    }
+
+    std::shared_ptr<ISeekableSource>
+    InputFactory::openSingleDecoder(const wchar_t *path)
+    {
+        std::shared_ptr<FILE> fp(win32::fopen(path, L"rb"));
+        if (m_is_raw)
+            return std::make_shared<RawSource>(fp, m_raw_format);
 
 #define TRY_MAKE_SHARED(type, ...) \
         do { \
             try { \
-                std::shared_ptr<type> src = \
-                    std::make_shared<type>(__VA_ARGS__); \
-                m_sources[path] = src; \
-                return src; \
+                return std::make_shared<type>(__VA_ARGS__); \
             } catch (...) { \
                 _lseeki64(fileno(fp.get()), 0, SEEK_SET); \
             } \
         } while (0)
 
-        TRY_MAKE_SHARED(WaveSource, fp, m_ignore_length);
-        if (!util::is_seekable(fileno(fp.get())))
+        /*
+         * Try the decoder for the sniffed format first.
+         * On failure, fall through to trying every other decoder in turn.
+         */
+        bool seekable = util::is_seekable(fileno(fp.get()));
+        FileFormat format = seekable ? sniff(fileno(fp.get()), path)
+                                     : kUnknown;
+        switch (format) {
+        case kWave:
+            TRY_MAKE_SHARED(WaveSource, fp, m_ignore_length);
+            break;
+        case kFLAC:
+            if (libflac.loaded())
+                TRY_MAKE_SHARED(FLACSource, libflac, fp);
+            else
+                TRY_MAKE_SHARED(NativeFLACSource, fp);
+            break;
+        case kWavpack:
+            if (libwavpack.loaded())
+                TRY_MAKE_SHARED(WavpackSource, libwavpack, path);
+            break;
+        case kTAK:
+            if (libtak.loaded() && libtak.compatible())
+                TRY_MAKE_SHARED(TakSource, libtak, fp);
+            break;
+#ifdef QAAC
+        case kMPEG4: case kCAF: case kAIFF: case kMPEGAudio:
+            TRY_MAKE_SHARED(ExtAFSource, fp);
+            break;
+#else
+        case kMPEG4:
+            TRY_MAKE_SHARED(ALACSource, fp);
+            break;
+        case kCAF: case kAIFF:
+            if (libsndfile.loaded())
+                TRY_MAKE_SHARED(LibSndfileSource, libsndfile, fp);
+            break;
+#endif
+        default:
+            break;
+        }
+        if (format != kWave)
+            TRY_MAKE_SHARED(WaveSource, fp, m_ignore_length);
+        if (!seekable)
             throw std::runtime_error("Not available input file format");
-        if (libflac.loaded())
-            TRY_MAKE_SHARED(FLACSource, libflac, fp);
-
-        if (libwavpack.loaded())
+        if (format != kFLAC) {
+            if (libflac.loaded())
+                TRY_MAKE_SHARED(FLACSource, libflac, fp);
+            else
+                TRY_MAKE_SHARED(NativeFLACSource, fp);
+        }
+        if (format != kWavpack && libwavpack.loaded())
             TRY_MAKE_SHARED(WavpackSource, libwavpack, path);
 
-        if (libtak.loaded() && libtak.compatible())
+        if (format != kTAK && libtak.loaded() && libtak.compatible())
             TRY_MAKE_SHARED(TakSource, libtak, fp);
 #ifdef QAAC
-        TRY_MAKE_SHARED(ExtAFSource, fp);
-#endif
+        if (format != kMPEG4 && format != kCAF && format != kAIFF &&
+            format != kMPEGAudio)
+            TRY_MAKE_SHARED(ExtAFSource, fp);
         if (libsndfile.loaded())
             TRY_MAKE_SHARED(LibSndfileSource, libsndfile, fp);
+#else
+        if (format != kCAF && format != kAIFF && libsndfile.loaded())
+            TRY_MAKE_SHARED(LibSndfileSource, libsndfile, fp);
 
-#ifndef QAAC
-        TRY_MAKE_SHARED(ALACSource, fp);
+        if (format != kMPEG4)
+            TRY_MAKE_SHARED(ALACSource, fp);
 #endif
         throw std::runtime_error("Not available input file format");
     }
+
+    void InputFactory::touchSource(LazySource *src, size_t ndecoders)
+    {
+        win32::Lock lock(m_pool_mutex);
+        std::list<pool_entry_t>::iterator pos = m_open_sources.begin();
+        while (pos != m_open_sources.end() && pos->first != src)
+            ++pos;
+        if (pos == m_open_sources.begin() && pos != m_open_sources.end()
+            && pos->second == ndecoders)
+            return;
+        if (pos != m_open_sources.end()) {
+            m_open_decoders -= pos->second;
+            m_open_sources.erase(pos);
+        }
+        m_open_sources.push_front(pool_entry_t(src, ndecoders));
+        m_open_decoders += ndecoders;
+
+        /* close least recently used ones, skipping those in use */
+        pos = m_open_sources.end();
+        while (m_open_decoders > m_max_open_sources &&
+               --pos != m_open_sources.begin())
+        {
+            if (pos->first->tryClose()) {
+                m_open_decoders -= pos->second;
+                pos = m_open_sources.erase(pos);
+            }
+        }
+    }
+
+    void InputFactory::releaseSource(LazySource *src)
+    {
+        win32::Lock lock(m_pool_mutex);
+        std::list<pool_entry_t>::iterator pos = m_open_sources.begin();
+        for (; pos != m_open_sources.end(); ++pos) {
+            if (pos->first == src) {
+                m_open_decoders -= pos->second;
+                m_open_sources.erase(pos);
+                break;
+            }
+        }
+    }
 }
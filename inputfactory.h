@@ -1,7 +1,9 @@
 #ifndef INPUTFACTORY_H
 #define INPUTFACTORY_H
 
+#include <list>
 #include "iointer.h"
+#include "win32util.h"
 #include "flacmodule.h"
 #include "wvpacksrc.h"
 #include "taksrc.h"
@@ -9,16 +11,53 @@
 #include "soxrmodule.h"
 #include "soxcmodule.h"
 
+class LazySource;
+
 namespace input {
     class InputFactory {
         AudioStreamBasicDescription m_raw_format;
         bool m_is_raw;
         bool m_ignore_length;
         std::map<std::wstring, std::shared_ptr<ISeekableSource> > m_sources;
+        /*
+         * LazySources with open decoder, most recently used first,
+         * with the number of decoder instances each one holds
+         */
+        typedef std::pair<LazySource*, size_t> pool_entry_t;
+        std::list<pool_entry_t> m_open_sources;
+        size_t m_open_decoders;
+        size_t m_max_open_sources;
+        win32::CriticalSection m_pool_mutex;
+        unsigned m_parallel_decode;
+        size_t m_block_samples;
     private:
-        InputFactory() : m_is_raw(false), m_ignore_length(false) {}
+        InputFactory()
+            : m_is_raw(false), m_ignore_length(false), m_open_decoders(0),
+              m_max_open_sources(16), m_parallel_decode(0),
+              m_block_samples(4096)
+        {}
     public:
+        /*
+         * Returns a LazySource for regular files, which is cheap to hold.
+         * Same source is returned for the same path.
+         */
         std::shared_ptr<ISeekableSource> open(const wchar_t *path);
+        /* really opens the file, without caching */
+        std::shared_ptr<ISeekableSource> openDecoder(const wchar_t *path);
+        /* same as openDecoder(), but never partitioned */
+        std::shared_ptr<ISeekableSource>
+            openSingleDecoder(const wchar_t *path);
+        /*
+         * number of decoders LazySources keep open at a time;
+         * each instance of a parallel decoder counts
+         */
+        void setMaxOpenSources(size_t n) { m_max_open_sources = n; }
+        /*
+         * LRU pool of open decoders, used by LazySource.
+         * ndecoders: number of decoder instances src currently holds
+         */
+        void touchSource(LazySource *src, size_t ndecoders);
+        void releaseSource(LazySource *src);
         static InputFactory *getInstance()
         {
             static InputFactory *instance = new InputFactory();
@@ -33,6 +72,18 @@ namespace input {
         {
             m_ignore_length = cond;
         }
+        /*
+         * Decode WavPack/TAK/FLAC input with n decoder instances in
+         * parallel (Ogg FLAC is excluded).
+         * 0 or 1 to disable.
+         * block_samples: block size of the filter chain, which the
+         * size of the chunks decoded by each instance is based on
+         */
+        void setParallelDecode(unsigned n, size_t block_samples)
+        {
+            m_parallel_decode = n;
+            m_block_samples = block_samples;
+        }
         FLACModule libflac;
         WavpackModule libwavpack;
         TakModule libtak;
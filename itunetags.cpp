@@ -274,6 +274,48 @@ void TagEditor::save(MP4FileX &file)
     }
 }
 
+#ifdef _WIN32
+namespace {
+    /*
+     * Resized artworks, shared by all the files written in a run.
+     * Keyed by content hash and size of the source image and the
+     * requested size, so that the same cover given for every track is
+     * converted once.
+     * Empty entry means the image is used as is.
+     */
+    struct ArtworkKey {
+        uint64_t hash;
+        size_t size;
+        uint32_t max_size;
+
+        bool operator<(const ArtworkKey &other) const
+        {
+            if (hash != other.hash) return hash < other.hash;
+            if (size != other.size) return size < other.size;
+            return max_size < other.max_size;
+        }
+    };
+    std::map<ArtworkKey, std::vector<char> > artwork_cache;
+
+    const std::vector<char> &convert_artwork(const char *data, size_t size,
+                                             uint32_t max_size)
+    {
+        ArtworkKey key = { util::FNV1A_INIT, size, max_size };
+        util::fnv1a(&key.hash, data, size);
+        std::map<ArtworkKey, std::vector<char> >::iterator
+            it = artwork_cache.find(key);
+        if (it != artwork_cache.end())
+            return it->second;
+        std::vector<char> vec;
+        if (!WICConvertArtwork(data, size, max_size, &vec))
+            vec.clear();
+        std::vector<char> &entry = artwork_cache[key];
+        entry.swap(vec);
+        return entry;
+    }
+}
+#endif
+
 void TagEditor::saveArtworks(MP4FileX &file)
 {
 #ifdef _WIN32
@@ -287,12 +329,13 @@ void TagEditor::saveArtworks(MP4FileX &file)
                 mp4v2::impl::itmf::computeBasicType(data, size);
             if (tc == mp4v2::impl::itmf::BT_IMPLICIT)
                 throw std::runtime_error("Unknown artwork image type");
-            std::vector<char> vec;
             if (m_artwork_size) {
-                bool res = WICConvertArtwork(data, size, m_artwork_size, &vec);
-                if (res) {
-                    data = &vec[0];
-                    size = vec.size();
+                const std::vector<char> &vec =
+                    convert_artwork(data, static_cast<size_t>(size),
+                                    m_artwork_size);
+                if (vec.size()) {
+                    file.SetMetadataArtwork("covr", &vec[0], vec.size());
+                    continue;
                 }
             }
             file.SetMetadataArtwork("covr", data, size);
@@ -541,37 +584,4 @@ namespace mp4a
         }
         return L"";
     }
-
-    void fetchTags(MP4FileX &file, std::map<uint32_t, std::wstring> *shortTags,
-                   std::map<std::string, std::wstring> *longTags)
-    {
-        std::map<uint32_t, std::wstring> stags;
-        std::map<std::string, std::wstring> ltags;
-        try {
-            MP4ItmfItemList *itemlist =
-                mp4v2::impl::itmf::genericGetItems(file);
-            if (!itemlist)
-                return;
-            std::shared_ptr<MP4ItmfItemList> __delete_later__(
-                    itemlist, mp4v2::impl::itmf::genericItemListFree);
-            for (size_t i = 0; i < itemlist->size; ++i) {
-                MP4ItmfItem &item = itemlist->elements[i];
-                uint32_t fcc = util::fourcc(item.code);
-                MP4ItmfData &data = item.dataList.elements[0];
-                if (!data.value)
-                    continue;
-                std::wstring v = parseValue(fcc, data);
-                if (!v.empty()) {
-                    if (fcc == '----')
-                        ltags[item.name] = v;
-                    else
-                        stags[fcc] = v;
-                }
-            }
-            if (shortTags) shortTags->swap(stags);
-            if (longTags) longTags->swap(ltags);
-        } catch (mp4v2::impl::Exception *e) {
-            handle_mp4error(e);
-        }
-    }
 }
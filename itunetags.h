@@ -75,9 +75,7 @@ namespace Vorbis {
 }
 
 namespace mp4a {
-    void fetchTags(MP4FileX &file,
-                   std::map<uint32_t, std::wstring> *shortTags,
-                   std::map<std::string, std::wstring> *longTags=0);
+    std::wstring parseValue(uint32_t fcc, const MP4ItmfData &data);
 }
 
 const wchar_t * const iTunSMPB_template = L" 00000000 %08X %08X %08X%08X "
@@ -0,0 +1,72 @@
+#include "lazysource.h"
+#include "inputfactory.h"
+#include "partitioned.h"
+
+LazySource::LazySource(const std::wstring &path,
+                       const std::shared_ptr<ISeekableSource> &src)
+    : m_path(path), m_src(src), m_position(0)
+{
+    m_length = src->length();
+    m_asbd = src->getSampleFormat();
+    const std::vector<uint32_t> *chanmap = src->getChannels();
+    if (chanmap)
+        m_chanmap = *chanmap;
+    ITagParser *parser = dynamic_cast<ITagParser*>(src.get());
+    if (parser) {
+        m_tags = parser->getTags();
+        const std::vector<chapters::entry_t> *chapters =
+            parser->getChapters();
+        if (chapters)
+            m_chapters = *chapters;
+    }
+    m_position = src->getPosition();
+    /* may be closed right away when the pool is full */
+    input::factory()->touchSource(this, numDecoders());
+}
+
+LazySource::~LazySource()
+{
+    input::factory()->releaseSource(this);
+}
+
+size_t LazySource::readSamples(void *buffer, size_t nsamples)
+{
+    win32::Lock lock(m_mutex);
+    size_t n = acquire()->readSamples(buffer, nsamples);
+    m_position += n;
+    return n;
+}
+
+void LazySource::seekTo(int64_t count)
+{
+    win32::Lock lock(m_mutex);
+    if (m_src.get())
+        m_src->seekTo(count);
+    m_position = count;
+}
+
+bool LazySource::tryClose()
+{
+    if (!m_mutex.tryEnter())
+        return false;
+    m_src.reset();
+    m_mutex.leave();
+    return true;
+}
+
+ISeekableSource *LazySource::acquire()
+{
+    if (!m_src.get()) {
+        m_src = input::factory()->openDecoder(m_path.c_str());
+        if (m_position)
+            m_src->seekTo(m_position);
+    }
+    input::factory()->touchSource(this, numDecoders());
+    return m_src.get();
+}
+
+size_t LazySource::numDecoders()
+{
+    PartitionedSource *p = dynamic_cast<PartitionedSource*>(m_src.get());
+    return p ? p->numDecoders() : 1;
+}
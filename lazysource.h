@@ -0,0 +1,60 @@
+#ifndef LAZYSOURCE_H
+#define LAZYSOURCE_H
+
+#include "iointer.h"
+#include "win32util.h"
+
+/*
+ * Handle of an input file which holds only metadata of the file.
+ * The decoder used to read the metadata is kept in the InputFactory's
+ * open source pool, which can close it at any time; it is reopened
+ * and seeked back to the current position when needed.
+ */
+class LazySource: public ISeekableSource, public ITagParser {
+    std::wstring m_path;
+    std::shared_ptr<ISeekableSource> m_src;
+    uint64_t m_length;
+    int64_t m_position;
+    AudioStreamBasicDescription m_asbd;
+    std::vector<uint32_t> m_chanmap;
+    std::map<uint32_t, std::wstring> m_tags;
+    std::vector<chapters::entry_t> m_chapters;
+    win32::CriticalSection m_mutex;
+public:
+    /* src: freshly opened source of path, kept as the first decoder */
+    LazySource(const std::wstring &path,
+               const std::shared_ptr<ISeekableSource> &src);
+    ~LazySource();
+    uint64_t length() const { return m_length; }
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_asbd;
+    }
+    const std::vector<uint32_t> *getChannels() const
+    {
+        return m_chanmap.size() ? &m_chanmap : 0;
+    }
+    int64_t getPosition() { return m_position; }
+    size_t readSamples(void *buffer, size_t nsamples);
+    bool isSeekable() { return true; }
+    void seekTo(int64_t count);
+    const std::map<uint32_t, std::wstring> &getTags() const
+    {
+        return m_tags;
+    }
+    const std::vector<chapters::entry_t> *getChapters() const
+    {
+        return m_chapters.size() ? &m_chapters : 0;
+    }
+    /*
+     * Called by the pool. Closes the decoder unless it's in use on
+     * another thread right now.
+     */
+    bool tryClose();
+private:
+    ISeekableSource *acquire();
+    /* decoder instances held by m_src, as counted by the pool */
+    size_t numDecoders();
+};
+
+#endif
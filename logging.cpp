@@ -1,3 +1,216 @@
+#include <new>
+#include <process.h>
+#include <malloc.h>
 #include "logging.h"
+#include "strutil.h"
+
+namespace {
+    std::wstring expand_job(const std::wstring &prefix,
+                            const std::wstring &job)
+    {
+        std::wstring result(prefix);
+        const std::wstring key(L"${job}");
+        size_t pos = 0;
+        while ((pos = result.find(key, pos)) != std::wstring::npos) {
+            result.replace(pos, key.size(), job);
+            pos += job.size();
+        }
+        return result;
+    }
+}
 
 Log *Log::m_instance = 0;
+
+Log::Log()
+    : m_stderr(false), m_bol(true), m_flush_request(0), m_flush_done(0),
+      m_stop(false)
+{
+    long h = _get_osfhandle(_fileno(stderr));
+    m_stderr_type = GetFileType(reinterpret_cast<HANDLE>(h));
+    void *p = _aligned_malloc(sizeof(SLIST_HEADER),
+                              MEMORY_ALLOCATION_ALIGNMENT);
+    if (!p)
+        throw std::bad_alloc();
+    m_queue = static_cast<PSLIST_HEADER>(p);
+    InitializeSListHead(m_queue);
+}
+
+Log::~Log()
+{
+    if (m_thread.get()) {
+        m_stop = true;
+        SetEvent(m_wakeup.get());
+        WaitForSingleObject(m_thread.get(), INFINITE);
+    }
+    drain();
+    if (m_partial.size())
+        write_shared(m_partial);
+    _aligned_free(m_queue);
+}
+
+void Log::enable_file(const wchar_t *filename)
+{
+    try {
+        if (m_prefix.size())
+            m_shared.push_back(open_shared(filename));
+        else {
+            FILE *fp = win32::wfopenx(filename, L"w");
+            _setmode(_fileno(fp), _O_U8TEXT);
+            std::setvbuf(fp, 0, _IOFBF, 0x10000);
+            m_files.push_back(std::shared_ptr<FILE>(fp, std::fclose));
+        }
+    } catch (...) {
+        return;
+    }
+    if (m_thread.get())
+        return;
+    m_wakeup = win32::create_event();
+    m_flushed = win32::create_event();
+    intptr_t h = _beginthreadex(0, 0, staticWriterThreadProc, this, 0, 0);
+    if (h != -1)
+        m_thread.reset(reinterpret_cast<HANDLE>(h), CloseHandle);
+}
+
+/*
+ * Opened for appending and shared with other processes. With only
+ * FILE_APPEND_DATA access, each WriteFile() is appended as a whole.
+ */
+std::shared_ptr<void> Log::open_shared(const wchar_t *filename)
+{
+    std::wstring path = win32::prefixed_path(filename);
+    HANDLE h = CreateFileW(path.c_str(), FILE_APPEND_DATA,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if (h == INVALID_HANDLE_VALUE)
+        win32::throw_error(path, GetLastError());
+    return std::shared_ptr<void>(h, CloseHandle);
+}
+
+void Log::write_shared(const std::wstring &s)
+{
+    std::string u8 = strutil::w2us(s);
+    for (size_t j = 0; j < m_shared.size(); ++j) {
+        DWORD nw;
+        WriteFile(m_shared[j].get(), u8.data(),
+                  static_cast<DWORD>(u8.size()), &nw, 0);
+    }
+}
+
+void Log::set_prefix(const std::wstring &prefix)
+{
+    win32::Lock lock(m_mutex);
+    m_prefix = prefix;
+    m_job_prefix = expand_job(prefix, m_job);
+}
+
+void Log::set_job(const std::wstring &job)
+{
+    win32::Lock lock(m_mutex);
+    m_job = job;
+    m_job_prefix = expand_job(m_prefix, job);
+}
+
+void Log::vwprintf(const wchar_t *fmt, va_list args)
+{
+    if (!is_enabled())
+        return;
+    /* va_list can be used twice without va_copy() on Windows */
+    int n = _vscwprintf(fmt, args);
+    if (n <= 0)
+        return;
+    std::vector<wchar_t> buffer(n + 1);
+    _vsnwprintf(&buffer[0], buffer.size(), fmt, args);
+    if (m_stderr) {
+        win32::Lock lock(m_mutex);
+        std::fputws(&buffer[0], stderr);
+    }
+    if (has_files())
+        push(std::wstring(&buffer[0], &buffer[n]));
+}
+
+void Log::write_files(const std::wstring &s)
+{
+    if (has_files())
+        push(s);
+}
+
+void Log::flush()
+{
+    if (!m_thread.get())
+        return;
+    win32::Lock lock(m_mutex);
+    LONG n = InterlockedIncrement(&m_flush_request);
+    SetEvent(m_wakeup.get());
+    while (m_flush_done < n)
+        WaitForSingleObject(m_flushed.get(), INFINITE);
+}
+
+void Log::push(const std::wstring &s)
+{
+    void *p = _aligned_malloc(sizeof(Message), MEMORY_ALLOCATION_ALIGNMENT);
+    if (!p)
+        return;
+    Message *msg = new (p) Message();
+    msg->text = s;
+    {
+        win32::Lock lock(m_mutex);
+        msg->prefix = m_job_prefix;
+    }
+    InterlockedPushEntrySList(m_queue, &msg->entry);
+    /* when the writer thread could not be started, write it here */
+    if (!m_thread.get()) {
+        win32::Lock lock(m_mutex);
+        drain();
+    }
+}
+
+/* only called by one thread at a time */
+void Log::drain()
+{
+    PSLIST_ENTRY entry = InterlockedFlushSList(m_queue);
+    std::vector<Message*> messages;
+    for (; entry; entry = entry->Next)
+        messages.push_back(reinterpret_cast<Message*>(entry));
+    /* the list is LIFO */
+    for (size_t i = messages.size(); i > 0; --i) {
+        Message *msg = messages[i - 1];
+        std::wstring text;
+        for (size_t k = 0; k < msg->text.size(); ++k) {
+            wchar_t c = msg->text[k];
+            if (m_bol && c != L'\n')
+                text += msg->prefix;
+            text.push_back(c);
+            m_bol = (c == L'\n');
+        }
+        for (size_t j = 0; j < m_files.size(); ++j)
+            std::fputws(text.c_str(), m_files[j].get());
+        if (m_shared.size())
+            m_partial += text;
+        msg->~Message();
+        _aligned_free(msg);
+    }
+    for (size_t j = 0; j < m_files.size(); ++j)
+        std::fflush(m_files[j].get());
+    /* the last incomplete line is kept until it is completed */
+    size_t eol = m_partial.rfind(L'\n');
+    if (eol != std::wstring::npos) {
+        write_shared(m_partial.substr(0, eol + 1));
+        m_partial.erase(0, eol + 1);
+    }
+}
+
+void Log::writerThreadProc()
+{
+    for (;;) {
+        WaitForSingleObject(m_wakeup.get(), FLUSH_INTERVAL);
+        bool stop = m_stop;
+        LONG request = m_flush_request;
+        drain();
+        if (request != m_flush_done) {
+            m_flush_done = request;
+            SetEvent(m_flushed.get());
+        }
+        if (stop)
+            break;
+    }
+}
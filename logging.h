@@ -3,10 +3,39 @@
 #include <vector>
 #include "win32util.h"
 
-/* non-thread safe */
+/*
+ * Thread safe.
+ * Messages to stderr are written synchronously by the calling thread, to
+ * keep them in order with the progress display. Messages to log files
+ * are pushed to a lock-free queue and written by a writer thread into
+ * buffered streams, which are flushed every FLUSH_INTERVAL milliseconds,
+ * on flush() and on exit.
+ * Shared log files are written directly to the handle, complete lines
+ * only, with one WriteFile() for each batch so that concurrent runs
+ * don't interleave in the middle of a line.
+ */
 class Log {
-    std::vector<std::shared_ptr<FILE> > m_streams;
+    enum { FLUSH_INTERVAL = 1000 };
+    struct Message {
+        SLIST_ENTRY entry; /* must be the first member */
+        std::wstring text;
+        std::wstring prefix; /* job prefix at the time it was logged */
+    };
+    bool m_stderr;
     DWORD m_stderr_type;
+    std::vector<std::shared_ptr<FILE> > m_files;
+    std::vector<std::shared_ptr<void> > m_shared; /* append only handles */
+    std::wstring m_partial; /* incomplete line not yet written to m_shared */
+    std::wstring m_prefix;
+    std::wstring m_job;
+    std::wstring m_job_prefix; /* m_prefix with ${job} replaced */
+    bool m_bol;             /* writer is at the beginning of a line */
+    PSLIST_HEADER m_queue;
+    win32::CriticalSection m_mutex;
+    std::shared_ptr<void> m_wakeup, m_flushed, m_thread;
+    volatile LONG m_flush_request;
+    volatile LONG m_flush_done;
+    volatile bool m_stop;
     static Log *m_instance;
 public:
     static Log *instance()
@@ -14,32 +43,39 @@ public:
         if (!m_instance) m_instance = new Log();
         return m_instance;
     }
-    bool is_enabled() { return m_streams.size() != 0; }
+    ~Log();
+    bool is_enabled() { return m_stderr || has_files(); }
     void enable_stderr()
     {
-        struct Lambda { static void call(FILE*) {} };
         if (m_stderr_type != FILE_TYPE_UNKNOWN)
-            m_streams.push_back(std::shared_ptr<FILE>(stderr, Lambda::call));
-    }
-    void enable_file(const wchar_t *filename)
-    {
-        try {
-            FILE *fp = win32::wfopenx(filename, L"w");
-            _setmode(_fileno(fp), _O_U8TEXT);
-            std::setbuf(fp, 0);
-            m_streams.push_back(std::shared_ptr<FILE>(fp, std::fclose));
-        } catch (...) {}
-    }
-    void vwprintf(const wchar_t *fmt, va_list args)
-    {
-        for (size_t i = 0; i < m_streams.size(); ++i)
-            std::vfwprintf(m_streams[i].get(), fmt, args);
+            m_stderr = true;
     }
+    /* appends to a shared file when a prefix is set (call set_prefix first) */
+    void enable_file(const wchar_t *filename);
+    /* prepended to each line written to log files; ${job} is expanded */
+    void set_prefix(const std::wstring &prefix);
+    /* name of the job (output file) currently processed */
+    void set_job(const std::wstring &job);
+    void vwprintf(const wchar_t *fmt, va_list args);
+    /* to log files only, not to stderr */
+    void write_files(const std::wstring &s);
+    /* waits until everything queued so far has been written */
+    void flush();
 private:
-    Log()
+    Log();
+    Log(const Log&);
+    Log& operator=(const Log&);
+    bool has_files() { return m_files.size() || m_shared.size(); }
+    static std::shared_ptr<void> open_shared(const wchar_t *filename);
+    void write_shared(const std::wstring &s);
+    void push(const std::wstring &s);
+    void drain();
+    void writerThreadProc();
+    static unsigned __stdcall staticWriterThreadProc(void *arg)
     {
-        long h = _get_osfhandle(_fileno(stderr));
-        m_stderr_type = GetFileType(reinterpret_cast<HANDLE>(h));
+        Log *self = static_cast<Log*>(arg);
+        self->writerThreadProc();
+        return 0;
     }
 };
 
@@ -24,12 +24,17 @@
 #include "Quantizer.h"
 #include "scaler.h"
 #include "pipedreader.h"
+#include "readahead.h"
 #include "TrimmedSource.h"
 #include "chanmap.h"
 #include "logging.h"
 #include "textfile.h"
 #include "expand.h"
 #include "compressor.h"
+#include "profiler.h"
+#include "eventstream.h"
+#include "signalsource.h"
+#include "counters.h"
 #ifdef REFALAC
 #include "alacenc.h"
 #endif
@@ -49,6 +54,8 @@
 #endif
 
 static volatile bool g_interrupted = false;
+/* set when a file was encoded slower than --min-speed */
+static volatile bool g_too_slow = false;
 
 static
 BOOL WINAPI console_interrupt_handler(DWORD type)
@@ -63,6 +70,24 @@ std::wstring errormsg(const std::exception &ex)
     return strutil::us2w(ex.what());
 }
 
+/*
+ * Number of frames read at once throughout the filter chain.
+ * Rounded up to a multiple of the encoder frame length, so that
+ * the encoder consumes whole blocks and never leaves a partial one
+ * behind in the buffering stages.
+ */
+static
+size_t chain_block_size(const Options &opts)
+{
+    size_t frame = 1;
+    if (opts.isALAC())
+        frame = 4096; /* kALACDefaultFramesPerPacket */
+    else if (opts.isAAC())
+        frame = opts.isSBR() ? 2048 : 1024;
+    size_t n = opts.block_size ? opts.block_size : 4096;
+    return (n + frame - 1) / frame * frame;
+}
+
 static
 void load_lyrics_file(Options *opts)
 {
@@ -199,10 +224,15 @@ class Progress {
     bool m_console_visible;
     DWORD m_stderr_type;
     int m_last_percent;
+    const char *m_phase;
+    IEncoderStat *m_stat;
+    DWORD m_last_event;
 public:
-    Progress(bool verbosity, uint64_t total, uint32_t rate)
+    Progress(bool verbosity, uint64_t total, uint32_t rate,
+             const char *phase="encode", IEncoderStat *stat=0)
         : m_disp(100, verbosity), m_verbose(verbosity),
-          m_total(total), m_rate(rate), m_last_percent(0)
+          m_total(total), m_rate(rate), m_last_percent(0),
+          m_phase(phase), m_stat(stat), m_last_event(GetTickCount())
     {
         long h = _get_osfhandle(_fileno(stderr));
         m_stderr_type = GetFileType(reinterpret_cast<HANDLE>(h));
@@ -212,6 +242,15 @@ public:
     }
     void update(uint64_t current)
     {
+        EventStream *events = EventStream::instance();
+        if (events->is_enabled()) {
+            DWORD tick = GetTickCount();
+            if (tick - m_last_event >= events->interval()) {
+                m_last_event = tick;
+                events->progress(m_phase, current, m_total, realtime(current),
+                                 m_stat ? m_stat->currentBitrate() : 0.0);
+            }
+        }
         if ((!m_verbose || !m_stderr_type) && !m_console_visible) return;
         double fcurrent = current;
         double percent = 100.0 * fcurrent / m_total;
@@ -231,20 +270,59 @@ public:
             m_disp.put(msg);
         }
     }
-    void finish(uint64_t current)
+    /* returns realtime factor */
+    double finish(uint64_t current)
     {
         m_disp.flush();
         if (m_verbose) fputwc('\n', stderr);
         double ellapsed = m_timer.ellapsed();
         LOG(L"%lld/%lld samples processed in %s\n",
             current, m_total, formatSeconds(ellapsed).c_str());
+        EventStream::instance()->end(m_phase, current, m_total,
+                                     realtime(current),
+                                     m_stat ? m_stat->overallBitrate() : 0.0);
+        return realtime(current);
+    }
+private:
+    double realtime(uint64_t current)
+    {
+        double ellapsed = m_timer.ellapsed();
+        return ellapsed ? current / (ellapsed * m_rate) : 0.0;
     }
 };
 
+/*
+ * Called after the output file is finished, so that a slow run still
+ * leaves a complete file and doesn't abort the rest of the batch.
+ * Failure is reported by exit status.
+ */
 static
-void do_encode(IEncoder *encoder, const std::wstring &ofilename,
+void check_speed(double speed, double rate, const Options &opts)
+{
+    if (g_interrupted || (!opts.signal && opts.min_speed <= 0.0))
+        return;
+    LOG(L"Throughput: %.0f samples/s (%.1fx realtime)\n", speed * rate, speed);
+    if (speed < opts.min_speed) {
+        LOG(L"ERROR: Speed %.1fx is below --min-speed %gx\n",
+            speed, opts.min_speed);
+        g_too_slow = true;
+    }
+}
+
+static
+uint32_t encode_chunk(IEncoder *encoder, profiler::Stats *stats)
+{
+    if (!stats)
+        return encoder->encodeChunk(1);
+    profiler::Scope scope(stats);
+    return encoder->encodeChunk(1);
+}
+
+/* returns encoding speed relative to realtime */
+static
+double do_encode(IEncoder *encoder, const std::wstring &ofilename,
                const std::vector<std::shared_ptr<ISource> > &chain,
-               const Options &opts)
+               const Options &opts, Profiler *profiler=0)
 {
     typedef std::shared_ptr<std::FILE> file_t;
     file_t statPtr;
@@ -256,20 +334,25 @@ void do_encode(IEncoder *encoder, const std::wstring &ofilename,
     IEncoderStat *stat = dynamic_cast<IEncoderStat*>(encoder);
 
     std::shared_ptr<ISource> src = chain.back();
-    Progress progress(opts.verbose, src->length(),
-                      src->getSampleFormat().mSampleRate);
+    double rate = src->getSampleFormat().mSampleRate;
+    Progress progress(opts.verbose, src->length(), rate, "encode", stat);
+    double speed = 0.0;
     try {
         FILE *statfp = statPtr.get();
-        while (!g_interrupted && encoder->encodeChunk(1)) {
+        profiler::Stats *encstat = profiler ? profiler->encoder() : 0;
+        while (!g_interrupted && encode_chunk(encoder, encstat)) {
             progress.update(src->getPosition());
             if (statfp)
                 std::fwprintf(statfp, L"%g\n", stat->currentBitrate());
         }
-        progress.finish(src->getPosition());
+        speed = progress.finish(src->getPosition());
+        if (profiler)
+            profiler->report(ofilename);
     } catch (...) {
         LOG(L"\n");
         throw;
     }
+    return speed;
 }
 
 static
@@ -401,13 +484,15 @@ static double do_normalize(std::vector<std::shared_ptr<ISource> > &chain,
     LOG(L"Scanning maximum peak...\n");
     uint64_t n = 0, rc;
     Progress progress(opts.verbose, src->length(),
-                      src->getSampleFormat().mSampleRate);
-    while (!g_interrupted && (rc = normalizer->process(4096)) > 0) {
+                      src->getSampleFormat().mSampleRate, "scan");
+    size_t nblock = chain_block_size(opts);
+    while (!g_interrupted && (rc = normalizer->process(nblock)) > 0) {
         n += rc;
         progress.update(src->getPosition());
     }
     progress.finish(src->getPosition());
     LOG(L"Peak value: %g\n", normalizer->getPeak());
+    EventStream::instance()->peak(normalizer->getPeak());
     return normalizer->getPeak();
 }
 
@@ -754,7 +839,10 @@ void build_filter_chain_sub(std::shared_ptr<ISeekableSource> src,
                 std::shared_ptr<SoxrResampler>
                     resampler(new SoxrResampler(input::factory()->libsoxr,
                                                 chain.back(),
-                                                oasbd.mSampleRate));
+                                                oasbd.mSampleRate,
+                                                opts.block_size ?
+                                                chain_block_size(opts) :
+                                                0x10000));
                 if (opts.verbose > 1 || opts.logfilename)
                     LOG(L"Using libsoxr SRC: %hs\n", resampler->engine());
                 chain.push_back(resampler);
@@ -851,8 +939,8 @@ void build_filter_chain_sub(std::shared_ptr<ISeekableSource> src,
         }
     }
     if (threading && (opts.isAAC() || opts.isALAC())) {
-        PipedReader *reader = new PipedReader(chain.back());
-        reader->start();
+        PipedReader *reader = new PipedReader(chain.back(),
+                                              chain_block_size(opts));
         chain.push_back(std::shared_ptr<ISource>(reader));
         if (opts.verbose > 1 || opts.logfilename)
             LOG(L"Enable threading\n");
@@ -909,7 +997,7 @@ void build_filter_chain(std::shared_ptr<ISeekableSource> src,
 static
 void decode_file(const std::vector<std::shared_ptr<ISource> > &chain,
                  const std::wstring &ofilename, const Options &opts,
-                 uint32_t chanmask)
+                 uint32_t chanmask, Profiler *profiler=0)
 {
     const std::shared_ptr<ISource> src = chain.back();
     const AudioStreamBasicDescription &sf = src->getSampleFormat();
@@ -925,20 +1013,27 @@ void decode_file(const std::vector<std::shared_ptr<ISource> > &chain,
         sink = std::make_shared<WaveOutSink>(sf, chanmask);
     else if (opts.isPeak())
         sink = std::make_shared<PeakSink>(sf);
+    std::shared_ptr<ISink> osink = profiler ? profiler->instrument(sink) : sink;
 
-    Progress progress(opts.verbose, src->length(), sf.mSampleRate);
+    Progress progress(opts.verbose, src->length(), sf.mSampleRate, "decode");
     uint32_t bpf = sf.mBytesPerFrame;
-    std::vector<uint8_t> buffer(4096 * bpf);
+    size_t nblock = chain_block_size(opts);
+    std::vector<uint8_t> buffer(nblock * bpf);
+    double speed = 0.0;
     try {
         size_t nread;
         while (!g_interrupted &&
-               (nread = src->readSamples(&buffer[0], 4096)) > 0) {
+               (nread = src->readSamples(&buffer[0], nblock)) > 0) {
             progress.update(src->getPosition());
-            sink->writeSamples(&buffer[0], nread * bpf, nread);
+            osink->writeSamples(&buffer[0], nread * bpf, nread);
         }
-        progress.finish(src->getPosition());
+        speed = progress.finish(src->getPosition());
+        if (profiler)
+            profiler->report(ofilename);
     } catch (const std::exception &e) {
         LOG(L"\nERROR: %s\n", errormsg(e).c_str());
+        Log::instance()->flush();
+        EventStream::instance()->error(errormsg(e));
     }
 
     if (opts.isLPCM()) {
@@ -947,7 +1042,10 @@ void decode_file(const std::vector<std::shared_ptr<ISource> > &chain,
     } else if (opts.isPeak()) {
         PeakSink *p = dynamic_cast<PeakSink *>(sink.get());
         LOG(L"peak: %g (%gdB)\n", p->peak(), util::scale_to_dB(p->peak()));
+        EventStream::instance()->peak(p->peak());
     }
+    if (speed > 0.0)
+        check_speed(speed, sf.mSampleRate, opts);
 }
 
 #ifdef QAAC
@@ -1171,8 +1269,13 @@ void encode_file(const std::shared_ptr<ISeekableSource> &src,
     std::vector<std::shared_ptr<ISource> > chain;
     build_filter_chain(src, chain, opts, &wavChanmask, &aacLayout,
                        &iasbd, &oasbd);
+    std::shared_ptr<Profiler> profiler;
+    if (opts.profile) {
+        profiler = std::make_shared<Profiler>();
+        profiler->instrument(chain);
+    }
     if (opts.isLPCM() || opts.isWaveOut() || opts.isPeak()) {
-        decode_file(chain, ofilename, opts, wavChanmask);
+        decode_file(chain, ofilename, opts, wavChanmask, profiler.get());
         return;
     }
     AudioConverterX converter(iasbd, oasbd);
@@ -1193,8 +1296,9 @@ void encode_file(const std::shared_ptr<ISeekableSource> &src,
         sink = std::make_shared<ADTSSink>(*adts_fp, cookie);
     else
         sink = open_sink(ofilename, opts, cookie);
-    encoder.setSink(sink);
-    do_encode(&encoder, ofilename, chain, opts);
+    encoder.setSink(profiler.get() ? profiler->instrument(sink) : sink);
+    double speed = do_encode(&encoder, ofilename, chain, opts,
+                             profiler.get());
     LOG(L"Overall bitrate: %gkbps\n", encoder.overallBitrate());
     MP4SinkBase *asink = dynamic_cast<MP4SinkBase*>(sink.get());
     if (asink) {
@@ -1204,6 +1308,7 @@ void encode_file(const std::shared_ptr<ISeekableSource> &src,
             do_optimize(asink->getFile(), ofilename, opts.verbose > 1);
         asink->close();
     }
+    check_speed(speed, chain.back()->getSampleFormat().mSampleRate, opts);
 }
 #endif // QAAC
 #ifdef REFALAC
@@ -1217,27 +1322,40 @@ void encode_file(const std::shared_ptr<ISeekableSource> &src,
     AudioStreamBasicDescription iasbd;
     std::vector<std::shared_ptr<ISource> > chain;
     build_filter_chain(src, chain, opts, &wavChanmask, &aacLayout, &iasbd, 0);
+    std::shared_ptr<Profiler> profiler;
+    if (opts.profile) {
+        profiler = std::make_shared<Profiler>();
+        profiler->instrument(chain);
+    }
 
     if (opts.isLPCM() || opts.isWaveOut() || opts.isPeak()) {
-        decode_file(chain, ofilename, opts, wavChanmask);
+        decode_file(chain, ofilename, opts, wavChanmask, profiler.get());
         return;
     }
     ALACEncoderX encoder(iasbd);
     encoder.setFastMode(opts.alac_fast);
+    encoder.setVerify(opts.verify);
     std::vector<uint8_t> cookie;
     encoder.getMagicCookie(&cookie);
 
     std::shared_ptr<ALACSink> sink =
         std::make_shared<ALACSink>(ofilename, cookie, !opts.no_optimize);
     encoder.setSource(chain.back());
-    encoder.setSink(sink);
-    do_encode(&encoder, ofilename, chain, opts);
+    if (profiler.get())
+        encoder.setSink(profiler->instrument(sink));
+    else
+        encoder.setSink(sink);
+    double speed = do_encode(&encoder, ofilename, chain, opts,
+                             profiler.get());
     LOG(L"Overall bitrate: %gkbps\n", encoder.overallBitrate());
+    if (opts.verify)
+        LOG(L"Verified OK, packet digest %016llx\n", encoder.digest());
     write_tags(sink->getFile(), opts, src.get(), &encoder,
                L"Apple Lossless Encoder");
     if (!opts.no_optimize)
         do_optimize(sink->getFile(), ofilename, opts.verbose > 1);
     sink->close();
+    check_speed(speed, chain.back()->getSampleFormat().mSampleRate, opts);
 }
 #endif
 
@@ -1276,6 +1394,13 @@ void setup_input_factory(const Options &opts)
         factory->setRawFormat(asbd);
     }
     factory->setIgnoreLength(opts.ignore_length);
+    factory->setMaxOpenSources(opts.max_open_files);
+    if (opts.threading) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        factory->setParallelDecode(std::min(si.dwNumberOfProcessors, 4UL),
+                                   chain_block_size(opts));
+    }
 }
 
 static
@@ -1293,7 +1418,8 @@ void load_cue_sheet(const wchar_t *ifilename, const Options &opts,
     cue.parse(&istream);
     cue.loadTracks(tracks, cuedir, 
                    opts.fname_format ? opts.fname_format
-                                     : L"${tracknumber}${title& }${title}");
+                                     : L"${tracknumber}${title& }${title}",
+                   opts.threading ? chain_block_size(opts) : 0);
 }
 
 static
@@ -1309,6 +1435,24 @@ void load_track(const wchar_t *ifilename, const Options &opts,
     std::shared_ptr<ISeekableSource>
         src(input::factory()->open(ifilename));
 
+    if (opts.threading) {
+        /*
+         * Same file can be given twice, and the factory returns the same
+         * source for it. Share one wrapper then, so that no two threads
+         * decode from the same source.
+         */
+        std::shared_ptr<ISeekableSource> ra;
+        for (size_t i = 0; i < tracks.size() && !ra.get(); ++i) {
+            ReadAheadSource *p =
+                dynamic_cast<ReadAheadSource*>(tracks[i].source.get());
+            if (p && p->source() == src.get())
+                ra = tracks[i].source;
+        }
+        if (!ra.get())
+            ra = std::make_shared<ReadAheadSource>(src,
+                                                   chain_block_size(opts));
+        src = ra;
+    }
     ITagParser *parser = dynamic_cast<ITagParser*>(src.get());
     if (parser) {
         const std::map<uint32_t, std::wstring> &meta =
@@ -1330,6 +1474,31 @@ void load_track(const wchar_t *ifilename, const Options &opts,
     tracks.push_back(new_track);
 }
 
+static
+void load_signal(const Options &opts, playlist::Playlist &tracks)
+{
+    std::wstring type(opts.signal);
+    double seconds = 60.0;
+    size_t pos = type.find(L':');
+    if (pos != std::wstring::npos) {
+        if (std::swscanf(type.c_str() + pos + 1, L"%lf", &seconds) != 1
+            || seconds <= 0.0)
+            throw std::runtime_error("Invalid --signal spec");
+        type = type.substr(0, pos);
+    }
+    AudioStreamBasicDescription asbd;
+    getRawFormat(opts, &asbd);
+    uint64_t length = static_cast<uint64_t>(seconds * asbd.mSampleRate + .5);
+    playlist::Track new_track;
+    new_track.number = 0;
+    new_track.name = type;
+    new_track.source =
+        std::make_shared<SignalSource>(SignalSource::typeFromName(type),
+                                       asbd, length);
+    new_track.ofilename = type + L".stub";
+    tracks.push_back(new_track);
+}
+
 static
 void group_tracks_with_formats(const playlist::Playlist &tracks,
                                std::vector<playlist::Playlist> *res)
@@ -1356,6 +1525,25 @@ void group_tracks_with_formats(const playlist::Playlist &tracks,
     res->swap(vec);
 }
 
+#ifdef QAAC_COUNTERS
+static void dump_counters(const Options &opts)
+{
+    std::string report = counters::report();
+    if (report.size())
+        LOG(L"%s", strutil::us2w(report).c_str());
+    if (opts.trace_file) {
+        try {
+            std::shared_ptr<FILE> fp = win32::fopen(opts.trace_file, L"w");
+            if (!counters::write_trace(fp.get()))
+                throw std::runtime_error(std::strerror(errno));
+        } catch (const std::exception &e) {
+            LOG(L"WARNING: trace: %s\n", errormsg(e).c_str());
+        }
+    }
+    Log::instance()->flush();
+}
+#endif
+
 struct ConsoleTitleSaver {
     wchar_t title[1024];
     ConsoleTitleSaver()
@@ -1412,8 +1600,18 @@ int wmain1(int argc, wchar_t **argv)
 
         if (opts.verbose && !opts.print_available_formats)
             Log::instance()->enable_stderr();
+        if (opts.log_prefix)
+            Log::instance()->set_prefix(opts.log_prefix);
         if (opts.logfilename && !opts.print_available_formats)
             Log::instance()->enable_file(opts.logfilename);
+        if (opts.progress_json && !opts.print_available_formats) {
+            EventStream::instance()->setInterval(opts.progress_interval);
+            EventStream::instance()->open(opts.progress_json);
+        }
+#ifdef QAAC_COUNTERS
+        if (opts.trace_file)
+            counters::enable_trace();
+#endif
 
         if (opts.nice)
             SetPriorityClass(GetCurrentProcess(), IDLE_PRIORITY_CLASS);
@@ -1509,6 +1707,10 @@ int wmain1(int argc, wchar_t **argv)
             };
             std::sort(&argv[0], &argv[argc], Sorter::cmp);
         }
+        if (opts.signal) {
+            load_signal(opts, tracks);
+            ifilename = tracks.back().ofilename.c_str();
+        }
         for (int i = 0; i < argc; ++i) {
             ifilename = argv[i];
             if (strutil::wslower(PathFindExtensionW(ifilename)) == L".cue")
@@ -1531,17 +1733,30 @@ int wmain1(int argc, wchar_t **argv)
                 const wchar_t *ofn = L"<stdout>";
                 if (ofilename != L"-")
                     ofn = PathFindFileNameW(ofilename.c_str());
+                Log::instance()->set_job(ofn);
                 LOG(L"\n%s\n", ofn);
+                EventStream::instance()->start(ofilename, track.name);
                 std::shared_ptr<ISeekableSource> src =
                     delayed_source(track.source, opts);
                 src->seekTo(0);
+                if (i + 1 < tracks.size()) {
+                    ReadAheadSource *next = dynamic_cast<ReadAheadSource*>(
+                            tracks[i + 1].source.get());
+                    if (next && next != track.source.get()) {
+                        next->seekTo(0);
+                        next->prime();
+                    }
+                }
                 encode_file(src, ofilename, opts);
             }
         } else {
             std::wstring ofilename = get_output_filename(ifilename, opts);
-            LOG(L"\n%s\n",
-                ofilename == L"-" ? L"<stdout>"
-                                  : PathFindFileNameW(ofilename.c_str()));
+            const wchar_t *ofn = L"<stdout>";
+            if (ofilename != L"-")
+                ofn = PathFindFileNameW(ofilename.c_str());
+            Log::instance()->set_job(ofn);
+            LOG(L"\n%s\n", ofn);
+            EventStream::instance()->start(ofilename, L"");
             std::shared_ptr<FILE> adts_fp;
             if (opts.is_adts)
                 adts_fp = win32::fopen(ofilename, L"wb+");
@@ -1581,8 +1796,16 @@ int wmain1(int argc, wchar_t **argv)
         if (opts.print_available_formats)
             Log::instance()->enable_stderr();
         LOG(L"ERROR: %s\n", errormsg(e).c_str());
+        Log::instance()->flush();
+        EventStream::instance()->error(errormsg(e));
         result = 2;
     }
+    if (!result && g_too_slow)
+        result = 3;
+#ifdef QAAC_COUNTERS
+    dump_counters(opts);
+#endif
+    delete EventStream::instance();
     delete Log::instance();
     return result;
 }
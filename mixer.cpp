@@ -2,6 +2,7 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include "cautil.h"
+#include "counters.h"
 
 static bool validateMatrix(const std::vector<std::vector<complex_t> > &mat,
                            uint32_t *nshifts)
@@ -129,6 +130,7 @@ void MatrixMixer::initFilter()
 
 size_t MatrixMixer::readSamples(void *buffer, size_t nsamples)
 {
+    TRACE_SPAN("mixer.readSamples");
     uint32_t ichannels = source()->getSampleFormat().mChannelsPerFrame;
     if (m_fbuffer.size() < nsamples * ichannels)
         m_fbuffer.resize(nsamples * ichannels);
@@ -190,6 +192,8 @@ size_t MatrixMixer::phaseShift(size_t nsamples)
                                 ichannels, ichannels, &ilen, &olen);
         }
         m_buffer.advance(ilen);
+        if (olen == 0)
+            COUNTER_INC("mixer.phaseShift.starved");
     } while (ilen != 0 && olen == 0);
 
     if (pass_channels_size > 0) {
@@ -0,0 +1,120 @@
+#include "mp4muxer.h"
+
+MP4Muxer::MP4Muxer(MP4FileX *file, MP4TrackId track_id)
+    : m_file(file), m_track_id(track_id), m_queued_bytes(0),
+      m_finishing(false), m_finished(false)
+{
+    m_ready = win32::create_event();
+    m_space = win32::create_event();
+    intptr_t h = _beginthreadex(0, 0, staticWriterThreadProc, this, 0, 0);
+    if (h == -1)
+        throw std::runtime_error(std::strerror(errno));
+    m_thread.reset(reinterpret_cast<HANDLE>(h), CloseHandle);
+}
+
+MP4Muxer::~MP4Muxer()
+{
+    try {
+        finish();
+    } catch (...) {}
+}
+
+void MP4Muxer::writeSample(const void *data, size_t length,
+                           MP4Duration duration)
+{
+    if (m_finished)
+        throw std::runtime_error("MP4Muxer: sample written after finish");
+    Sample sample;
+    {
+        win32::Lock lock(m_mutex);
+        if (m_free.size()) {
+            sample.data.swap(m_free.back());
+            m_free.pop_back();
+        }
+    }
+    /* the caller reuses its buffer, so we need a copy */
+    const uint8_t *bp = static_cast<const uint8_t*>(data);
+    sample.data.assign(bp, bp + length);
+    for (;;) {
+        {
+            win32::Lock lock(m_mutex);
+            if (!m_error.empty())
+                throw std::runtime_error(m_error);
+            if (m_queued_bytes < MAX_QUEUED_BYTES) {
+                m_queue.push_back(Sample());
+                m_queue.back().data.swap(sample.data);
+                m_queue.back().duration = duration;
+                m_queued_bytes += length;
+                break;
+            }
+        }
+        WaitForSingleObject(m_space.get(), INFINITE);
+    }
+    SetEvent(m_ready.get());
+}
+
+void MP4Muxer::finish()
+{
+    if (m_thread.get()) {
+        {
+            win32::Lock lock(m_mutex);
+            m_finishing = true;
+        }
+        SetEvent(m_ready.get());
+        WaitForSingleObject(m_thread.get(), INFINITE);
+        m_thread.reset();
+        m_finished = true;
+        std::deque<Sample>().swap(m_queue);
+        std::vector<std::vector<uint8_t> >().swap(m_free);
+    }
+    if (!m_error.empty())
+        throw std::runtime_error(m_error);
+}
+
+void MP4Muxer::writerThreadProc()
+{
+    for (;;) {
+        Sample sample;
+        bool found = false, done = false;
+        {
+            win32::Lock lock(m_mutex);
+            if (m_queue.size()) {
+                sample.data.swap(m_queue.front().data);
+                sample.duration = m_queue.front().duration;
+                m_queue.pop_front();
+                found = true;
+            } else
+                done = m_finishing;
+        }
+        if (done)
+            break;
+        if (!found) {
+            WaitForSingleObject(m_ready.get(), INFINITE);
+            continue;
+        }
+        std::string error;
+        try {
+            m_file->WriteSample(m_track_id,
+                                sample.data.size() ? &sample.data[0] : 0,
+                                sample.data.size(), sample.duration);
+        } catch (mp4v2::impl::Exception *e) {
+            error = format_mp4error(*e);
+            delete e;
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+        {
+            win32::Lock lock(m_mutex);
+            m_queued_bytes -= sample.data.size();
+            if (m_free.size() < MAX_FREE) {
+                m_free.push_back(std::vector<uint8_t>());
+                m_free.back().swap(sample.data);
+            }
+            if (!error.empty())
+                m_error = error;
+        }
+        SetEvent(m_space.get());
+        if (!error.empty())
+            break;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef MP4MUXER_H
+#define MP4MUXER_H
+
+#include <deque>
+#include <process.h>
+#include "mp4v2wrapper.h"
+#include "win32util.h"
+
+/*
+ * Write-behind of the samples of one MP4 track.
+ * The producer only copies samples into a queue, and a writer thread
+ * writes them to the MP4FileX, so that encoding doesn't wait on disk
+ * I/O. Other tracks (chapters) are added after finish() as before.
+ * While the muxer is running, nobody else may touch the MP4FileX.
+ */
+class MP4Muxer {
+    struct Sample {
+        std::vector<uint8_t> data;
+        MP4Duration duration;
+    };
+    MP4FileX *m_file;
+    MP4TrackId m_track_id;
+    std::deque<Sample> m_queue;
+    std::vector<std::vector<uint8_t> > m_free; /* recycled sample buffers */
+    size_t m_queued_bytes;
+    bool m_finishing;
+    bool m_finished;
+    std::string m_error;
+    win32::CriticalSection m_mutex;
+    std::shared_ptr<void> m_ready, m_space, m_thread;
+public:
+    /*
+     * producer blocks only when MAX_QUEUED_BYTES is waiting for disk.
+     * up to MAX_FREE written sample buffers are kept for reuse.
+     */
+    enum { MAX_QUEUED_BYTES = 0x4000000, MAX_FREE = 64 };
+
+    MP4Muxer(MP4FileX *file, MP4TrackId track_id);
+    ~MP4Muxer();
+    void writeSample(const void *data, size_t length, MP4Duration duration);
+    /*
+     * waits until everything is written, then stops the writer.
+     * writeSample() is an error after this.
+     */
+    void finish();
+private:
+    void writerThreadProc();
+    static unsigned __stdcall staticWriterThreadProc(void *arg)
+    {
+        MP4Muxer *self = static_cast<MP4Muxer*>(arg);
+        self->writerThreadProc();
+        return 0;
+    }
+};
+
+#endif
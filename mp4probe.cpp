@@ -0,0 +1,291 @@
+#include "mp4probe.h"
+#include "util.h"
+#include "itunetags.h"
+
+namespace {
+    inline uint32_t get32(const uint8_t *p)
+    {
+        return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    inline uint64_t get64(const uint8_t *p)
+    {
+        return (static_cast<uint64_t>(get32(p)) << 32) | get32(p + 4);
+    }
+
+    struct Atom {
+        uint32_t type;
+        int64_t data;   /* start of payload */
+        int64_t end;
+    };
+
+    class AtomReader {
+        int m_fd;
+        int64_t m_size;
+    public:
+        /* atoms larger than this are never loaded in memory */
+        enum { MAX_LOAD_SIZE = 0x1000000 };
+
+        explicit AtomReader(int fd): m_fd(fd)
+        {
+            m_size = _lseeki64(fd, 0, SEEK_END);
+        }
+        int64_t size() const { return m_size; }
+
+        bool readAt(int64_t pos, void *buffer, size_t size)
+        {
+            if (_lseeki64(m_fd, pos, SEEK_SET) != pos)
+                return false;
+            ssize_t n = util::nread(m_fd, buffer, size);
+            return n == static_cast<ssize_t>(size);
+        }
+        /* reads header of the atom at pos, which must end before end */
+        bool next(int64_t pos, int64_t end, Atom *atom)
+        {
+            uint8_t h[16];
+            if (end - pos < 8 || !readAt(pos, h, 8))
+                return false;
+            uint64_t size = get32(h);
+            atom->type = get32(h + 4);
+            atom->data = pos + 8;
+            if (size == 1) {
+                if (end - pos < 16 || !readAt(pos + 8, h + 8, 8))
+                    return false;
+                size = get64(h + 8);
+                atom->data += 8;
+            } else if (size == 0)
+                size = end - pos;
+            if (size < static_cast<uint64_t>(atom->data - pos) ||
+                size > static_cast<uint64_t>(end - pos))
+                return false;
+            atom->end = pos + size;
+            return true;
+        }
+        /* loads payload of atom, skipping first "skip" bytes */
+        bool load(const Atom &atom, size_t skip, std::vector<uint8_t> *buf)
+        {
+            int64_t size = atom.end - atom.data - skip;
+            if (size < 0 || size > MAX_LOAD_SIZE)
+                return false;
+            buf->resize(size);
+            return !size || readAt(atom.data + skip, &(*buf)[0], size);
+        }
+    };
+
+    class Prober {
+        AtomReader m_reader;
+        mp4a::ProbeInfo *m_info;
+    public:
+        Prober(int fd, mp4a::ProbeInfo *info)
+            : m_reader(fd), m_info(info)
+        {}
+        bool run()
+        {
+            int64_t end = m_reader.size();
+            if (end <= 0)
+                return false;
+            Atom atom;
+            for (int64_t pos = 0; m_reader.next(pos, end, &atom);
+                 pos = atom.end)
+            {
+                if (pos == 0 && atom.type != 'ftyp')
+                    return false;
+                if (atom.type == 'moov') {
+                    moov(atom);
+                    return m_info->codec != 0;
+                }
+            }
+            return false;
+        }
+    private:
+        void moov(const Atom &parent)
+        {
+            Atom atom;
+            for (int64_t pos = parent.data;
+                 m_reader.next(pos, parent.end, &atom); pos = atom.end)
+            {
+                if (atom.type == 'trak' && !m_info->codec)
+                    trak(atom);
+                else if (atom.type == 'udta')
+                    udta(atom);
+            }
+        }
+        void trak(const Atom &parent)
+        {
+            bool has_chap = false;
+            mp4a::ProbeInfo info;
+            uint32_t handler = 0;
+            Atom atom;
+            for (int64_t pos = parent.data;
+                 m_reader.next(pos, parent.end, &atom); pos = atom.end)
+            {
+                if (atom.type == 'tref')
+                    has_chap = findChild(atom, 'chap');
+                else if (atom.type == 'mdia')
+                    mdia(atom, &info, &handler);
+            }
+            if (handler != 'soun' || !info.codec)
+                return;
+            m_info->codec = info.codec;
+            m_info->timescale = info.timescale;
+            m_info->duration = info.duration;
+            m_info->cookie.swap(info.cookie);
+            m_info->chan.swap(info.chan);
+            m_info->has_chapters |= has_chap;
+        }
+        void mdia(const Atom &parent, mp4a::ProbeInfo *info,
+                  uint32_t *handler)
+        {
+            std::vector<uint8_t> buf;
+            Atom atom;
+            for (int64_t pos = parent.data;
+                 m_reader.next(pos, parent.end, &atom); pos = atom.end)
+            {
+                if (atom.type == 'mdhd' && m_reader.load(atom, 0, &buf)) {
+                    if (buf.size() >= 24 && buf[0] == 0) {
+                        info->timescale = get32(&buf[12]);
+                        info->duration = get32(&buf[16]);
+                    } else if (buf.size() >= 32 && buf[0] == 1) {
+                        info->timescale = get32(&buf[20]);
+                        info->duration = get64(&buf[24]);
+                    }
+                } else if (atom.type == 'hdlr' &&
+                           m_reader.load(atom, 0, &buf)) {
+                    if (buf.size() >= 12)
+                        *handler = get32(&buf[8]);
+                } else if (atom.type == 'minf') {
+                    Atom stbl, stsd;
+                    if (findChild(atom, 'stbl', &stbl) &&
+                        findChild(stbl, 'stsd', &stsd))
+                        sampleEntry(stsd, info);
+                }
+            }
+        }
+        void sampleEntry(const Atom &stsd, mp4a::ProbeInfo *info)
+        {
+            Atom entry;
+            uint8_t h[10];
+            /* version/flags, entry count, then the first entry */
+            if (!m_reader.next(stsd.data + 8, stsd.end, &entry) ||
+                !m_reader.readAt(entry.data, h, 10))
+                return;
+            info->codec = entry.type;
+            /* SoundDescription, version 1 and 2 are QuickTime extensions */
+            unsigned version = (h[8] << 8) | h[9];
+            int64_t offset = 28;
+            if (version == 1)
+                offset += 16;
+            else if (version == 2)
+                offset += 36;
+            entry.data += offset;
+            codecConfig(entry, info);
+        }
+        void codecConfig(const Atom &parent, mp4a::ProbeInfo *info)
+        {
+            Atom atom;
+            for (int64_t pos = parent.data;
+                 m_reader.next(pos, parent.end, &atom); pos = atom.end)
+            {
+                if (atom.type == 'wave')
+                    codecConfig(atom, info);
+                else if (atom.type == info->codec && info->codec == 'alac')
+                    m_reader.load(atom, 4, &info->cookie);
+                else if (atom.type == 'chan')
+                    m_reader.load(atom, 4, &info->chan);
+            }
+        }
+        void udta(const Atom &parent)
+        {
+            Atom atom, ilst;
+            for (int64_t pos = parent.data;
+                 m_reader.next(pos, parent.end, &atom); pos = atom.end)
+            {
+                if (atom.type == 'chpl')
+                    m_info->has_chapters = true;
+                else if (atom.type == 'meta') {
+                    /*
+                     * meta is a full atom in ISO files, but not in
+                     * QuickTime files. Look for hdlr to tell them apart.
+                     */
+                    uint8_t h[8];
+                    if (!m_reader.readAt(atom.data, h, 8))
+                        continue;
+                    if (get32(h + 4) != 'hdlr')
+                        atom.data += 4;
+                    if (findChild(atom, 'ilst', &ilst))
+                        items(ilst);
+                }
+            }
+        }
+        void items(const Atom &parent)
+        {
+            Atom atom;
+            for (int64_t pos = parent.data;
+                 m_reader.next(pos, parent.end, &atom); pos = atom.end)
+            {
+                if (atom.type != Tag::kArtwork)
+                    item(atom);
+            }
+        }
+        void item(const Atom &parent)
+        {
+            std::string name;
+            std::vector<uint8_t> buf;
+            Atom atom;
+            bool found = false;
+            for (int64_t pos = parent.data;
+                 m_reader.next(pos, parent.end, &atom); pos = atom.end)
+            {
+                if (atom.type == 'name' && m_reader.load(atom, 4, &buf))
+                    name.assign(buf.begin(), buf.end());
+                else if ((found = (atom.type == 'data')))
+                    break;
+            }
+            /* only the first data atom is used, as mp4v2 does */
+            if (!found || !m_reader.load(atom, 0, &buf) || buf.size() <= 8)
+                return;
+            uint32_t fcc = parent.type;
+            MP4ItmfData data = { 0 };
+            data.typeCode = static_cast<MP4ItmfBasicType>(get32(&buf[0])
+                                                          & 0xffffff);
+            data.locale = get32(&buf[4]);
+            data.value = &buf[8];
+            data.valueSize = buf.size() - 8;
+            if (((fcc == Tag::kTrack || fcc == Tag::kDisk) &&
+                 data.valueSize < 6) ||
+                (fcc == Tag::kGenreID3 && data.valueSize < 2))
+                return;
+            std::wstring value = mp4a::parseValue(fcc, data);
+            if (value.empty())
+                return;
+            if (fcc == '----')
+                m_info->longTags[name] = value;
+            else
+                m_info->shortTags[fcc] = value;
+        }
+        bool findChild(const Atom &parent, uint32_t type, Atom *result=0)
+        {
+            Atom atom;
+            for (int64_t pos = parent.data;
+                 m_reader.next(pos, parent.end, &atom); pos = atom.end)
+            {
+                if (atom.type == type) {
+                    if (result) *result = atom;
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+}
+
+namespace mp4a {
+    bool probe(int fd, ProbeInfo *info)
+    {
+        util::FilePositionSaver _(fd);
+        ProbeInfo result;
+        if (!Prober(fd, &result).run())
+            return false;
+        std::swap(*info, result);
+        return true;
+    }
+}
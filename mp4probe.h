@@ -0,0 +1,33 @@
+#ifndef MP4PROBE_H
+#define MP4PROBE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace mp4a {
+    /*
+     * Header-only view of an MP4/M4A file.
+     * Only the atoms needed for format, duration, magic cookie and tags
+     * are visited. Sample tables, mdat and artwork are skipped over.
+     */
+    struct ProbeInfo {
+        uint32_t codec;         /* sample entry of the first audio track */
+        uint32_t timescale;
+        uint64_t duration;      /* in timescale */
+        bool has_chapters;      /* tref.chap or udta.chpl is present */
+        std::vector<uint8_t> cookie; /* alac: ALACSpecificConfig */
+        std::vector<uint8_t> chan;   /* AudioChannelLayout */
+        std::map<uint32_t, std::wstring> shortTags;
+        std::map<std::string, std::wstring> longTags;
+
+        ProbeInfo(): codec(0), timescale(0), duration(0), has_chapters(false)
+        {}
+    };
+
+    /* returns false when fd is not an MP4 file with an audio track */
+    bool probe(int fd, ProbeInfo *info);
+}
+
+#endif
@@ -123,11 +123,11 @@ File::close()
 {
     if( !_isOpen )
         return false;
-    if( _provider.close() )
-        return true;
 
+    // the provider releases its handle even when close fails,
+    // so never hand it to close() again (from the destructor)
     _isOpen = false;
-    return false;
+    return _provider.close();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
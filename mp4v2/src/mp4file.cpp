@@ -617,6 +617,12 @@ void MP4File::Close(uint32_t options)
     if( IsWriteMode() ) {
         SetIntegerProperty( "moov.mvhd.modificationTime", MP4GetAbsTimestamp() );
         FinishWrite(options);
+        // buffered providers write out pending data on close
+        if( m_file->close() ) {
+            delete m_file;
+            m_file = NULL;
+            throw new PlatformException( "close failed", sys::getLastError(), __FILE__, __LINE__, __FUNCTION__ );
+        }
     }
 
     delete m_file;
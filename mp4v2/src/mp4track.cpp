@@ -64,7 +64,6 @@ MP4Track::MP4Track(MP4File& file, MP4Atom& trakAtom)
     m_isAmr = AMR_UNINITIALIZED;
     m_curMode = 0;
 
-    m_cachedSttsSid = MP4_INVALID_SAMPLE_ID;
     m_cachedCttsSid = MP4_INVALID_SAMPLE_ID;
 
     bool success = true;
@@ -861,26 +860,24 @@ uint32_t MP4Track::GetMaxBitrate()
 
 uint32_t MP4Track::GetSampleStscIndex(MP4SampleId sampleId)
 {
-    uint32_t stscIndex;
     uint32_t numStscs = m_pStscCountProperty->GetValue();
 
     if (numStscs == 0) {
         throw new Exception("No data chunks exist", __FILE__, __LINE__, __FUNCTION__ );
     }
 
-    for (stscIndex = 0; stscIndex < numStscs; stscIndex++) {
-        if (sampleId < m_pStscFirstSampleProperty->GetValue(stscIndex)) {
-            ASSERT(stscIndex != 0);
-            stscIndex -= 1;
-            break;
-        }
-    }
-    if (stscIndex == numStscs) {
-        ASSERT(stscIndex != 0);
-        stscIndex -= 1;
+    // last entry with firstSample <= sampleId
+    uint32_t lo = 0, hi = numStscs;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (sampleId < m_pStscFirstSampleProperty->GetValue(mid))
+            hi = mid;
+        else
+            lo = mid;
     }
+    ASSERT(sampleId >= m_pStscFirstSampleProperty->GetValue(lo));
 
-    return stscIndex;
+    return lo;
 }
 
 File* MP4Track::GetSampleFile( MP4SampleId sampleId )
@@ -1054,94 +1051,120 @@ void MP4Track::SetFixedSampleDuration(MP4Duration duration)
     return;
 }
 
-void MP4Track::GetSampleTimes(MP4SampleId sampleId,
-                              MP4Timestamp* pStartTime, MP4Duration* pDuration)
+void MP4Track::UpdateSttsIndex()
 {
     uint32_t numStts = m_pSttsCountProperty->GetValue();
-    MP4SampleId sid;
-    MP4Duration elapsed;
-
+    uint32_t n = m_sttsStartSid.Size();
 
-    if (m_cachedSttsSid != MP4_INVALID_SAMPLE_ID && sampleId >= m_cachedSttsSid) {
-        sid   = m_cachedSttsSid;
-        elapsed   = m_cachedSttsElapsed;
-    } else {
-        m_cachedSttsIndex = 0;
-        sid   = 1;
-        elapsed   = 0;
+    if (n == 0 && numStts) {
+        m_sttsStartSid.Add(1);
+        m_sttsStartTime.Add(0);
+        n = 1;
     }
-
-    for (uint32_t sttsIndex = m_cachedSttsIndex; sttsIndex < numStts; sttsIndex++) {
+    // entries before the last one are final
+    for (; n < numStts; ++n) {
         uint32_t sampleCount =
-            m_pSttsSampleCountProperty->GetValue(sttsIndex);
+            m_pSttsSampleCountProperty->GetValue(n - 1);
         uint32_t sampleDelta =
-            m_pSttsSampleDeltaProperty->GetValue(sttsIndex);
-
-        if (sampleId <= sid + sampleCount - 1) {
-            if (pStartTime) {
-                *pStartTime = (sampleId - sid);
-                *pStartTime *= sampleDelta;
-                *pStartTime += elapsed;
-            }
-            if (pDuration) {
-                *pDuration = sampleDelta;
-            }
+            m_pSttsSampleDeltaProperty->GetValue(n - 1);
+        m_sttsStartSid.Add(m_sttsStartSid[n - 1] + sampleCount);
+        m_sttsStartTime.Add(m_sttsStartTime[n - 1] +
+                            (MP4Duration)sampleCount * sampleDelta);
+    }
+}
 
-            m_cachedSttsIndex = sttsIndex;
-            m_cachedSttsSid = sid;
-            m_cachedSttsElapsed = elapsed;
+uint32_t MP4Track::GetSampleSttsIndex(MP4SampleId sampleId)
+{
+    UpdateSttsIndex();
 
-            return;
-        }
-        sid += sampleCount;
-        elapsed += sampleCount * sampleDelta;
+    uint32_t numStts = m_pSttsCountProperty->GetValue();
+    if (numStts == 0 || sampleId < 1) {
+        throw new Exception("sample id out of range",
+                            __FILE__, __LINE__, __FUNCTION__ );
     }
+    // last entry with startSid <= sampleId
+    uint32_t lo = 0, hi = numStts;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (sampleId < m_sttsStartSid[mid])
+            hi = mid;
+        else
+            lo = mid;
+    }
+    if (sampleId - m_sttsStartSid[lo] >=
+            m_pSttsSampleCountProperty->GetValue(lo)) {
+        throw new Exception("sample id out of range",
+                            __FILE__, __LINE__, __FUNCTION__ );
+    }
+    return lo;
+}
 
-    throw new Exception("sample id out of range",
-                        __FILE__, __LINE__, __FUNCTION__ );
+void MP4Track::GetSampleTimes(MP4SampleId sampleId,
+                              MP4Timestamp* pStartTime, MP4Duration* pDuration)
+{
+    uint32_t sttsIndex = GetSampleSttsIndex(sampleId);
+    uint32_t sampleDelta =
+        m_pSttsSampleDeltaProperty->GetValue(sttsIndex);
+
+    if (pStartTime) {
+        *pStartTime = (sampleId - m_sttsStartSid[sttsIndex]);
+        *pStartTime *= sampleDelta;
+        *pStartTime += m_sttsStartTime[sttsIndex];
+    }
+    if (pDuration) {
+        *pDuration = sampleDelta;
+    }
 }
 
 MP4SampleId MP4Track::GetSampleIdFromTime(
     MP4Timestamp when,
     bool wantSyncSample)
 {
-    uint32_t numStts = m_pSttsCountProperty->GetValue();
-    MP4SampleId sid = 1;
-    MP4Duration elapsed = 0;
-
-    for (uint32_t sttsIndex = 0; sttsIndex < numStts; sttsIndex++) {
-        uint32_t sampleCount =
-            m_pSttsSampleCountProperty->GetValue(sttsIndex);
-        uint32_t sampleDelta =
-            m_pSttsSampleDeltaProperty->GetValue(sttsIndex);
+    UpdateSttsIndex();
 
-        if (sampleDelta == 0 && sttsIndex < numStts - 1) {
-            log.warningf("%s: \"%s\": Zero sample duration, stts entry %u",
-                         __FUNCTION__, GetFile().GetFilename().c_str(), sttsIndex);
-        }
+    uint32_t numStts = m_pSttsCountProperty->GetValue();
+    if (numStts == 0) {
+        throw new Exception("time out of range",
+                            __FILE__, __LINE__, __FUNCTION__);
+    }
 
-        MP4Duration d = when - elapsed;
+    // first entry whose end time is >= when.
+    // end of entry i is the start of entry i + 1, except for the last one.
+    uint32_t lo = 0, hi = numStts - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (m_sttsStartTime[mid + 1] < when)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    uint32_t sttsIndex = lo;
+    uint32_t sampleCount =
+        m_pSttsSampleCountProperty->GetValue(sttsIndex);
+    uint32_t sampleDelta =
+        m_pSttsSampleDeltaProperty->GetValue(sttsIndex);
 
-        if (d <= sampleCount * sampleDelta) {
-            MP4SampleId sampleId = sid;
-            if (sampleDelta) {
-                sampleId += (d / sampleDelta);
-            }
+    if (sampleDelta == 0 && sttsIndex < numStts - 1) {
+        log.warningf("%s: \"%s\": Zero sample duration, stts entry %u",
+                     __FUNCTION__, GetFile().GetFilename().c_str(), sttsIndex);
+    }
 
-            if (wantSyncSample) {
-                return GetNextSyncSample(sampleId);
-            }
-            return sampleId;
-        }
+    MP4Duration d = when - m_sttsStartTime[sttsIndex];
 
-        sid += sampleCount;
-        elapsed += sampleCount * sampleDelta;
+    if (d > (MP4Duration)sampleCount * sampleDelta) {
+        throw new Exception("time out of range",
+                            __FILE__, __LINE__, __FUNCTION__);
     }
 
-    throw new Exception("time out of range",
-                        __FILE__, __LINE__, __FUNCTION__);
+    MP4SampleId sampleId = m_sttsStartSid[sttsIndex];
+    if (sampleDelta) {
+        sampleId += (d / sampleDelta);
+    }
 
-    return 0; // satisfy MS compiler
+    if (wantSyncSample) {
+        return GetNextSyncSample(sampleId);
+    }
+    return sampleId;
 }
 
 void MP4Track::UpdateSampleTimes(MP4Duration duration)
@@ -1508,19 +1531,23 @@ uint32_t MP4Track::GetNumberOfChunks()
 
 uint32_t MP4Track::GetChunkStscIndex(MP4ChunkId chunkId)
 {
-    uint32_t stscIndex;
     uint32_t numStscs = m_pStscCountProperty->GetValue();
 
     ASSERT(chunkId);
     ASSERT(numStscs > 0);
 
-    for (stscIndex = 0; stscIndex < numStscs; stscIndex++) {
-        if (chunkId < m_pStscFirstChunkProperty->GetValue(stscIndex)) {
-            ASSERT(stscIndex != 0);
-            break;
-        }
+    // last entry with firstChunk <= chunkId
+    uint32_t lo = 0, hi = numStscs;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (chunkId < m_pStscFirstChunkProperty->GetValue(mid))
+            hi = mid;
+        else
+            lo = mid;
     }
-    return stscIndex - 1;
+    ASSERT(chunkId >= m_pStscFirstChunkProperty->GetValue(lo));
+
+    return lo;
 }
 
 MP4Timestamp MP4Track::GetChunkTime(MP4ChunkId chunkId)
@@ -168,6 +168,8 @@ protected:
 
     File*       GetSampleFile( MP4SampleId sampleId );
     uint64_t    GetSampleFileOffset(MP4SampleId sampleId);
+    void        UpdateSttsIndex();
+    uint32_t    GetSampleSttsIndex(MP4SampleId sampleId);
     uint32_t    GetSampleStscIndex(MP4SampleId sampleId);
     uint32_t    GetChunkStscIndex(MP4ChunkId chunkId);
     uint32_t    GetChunkSize(MP4ChunkId chunkId);
@@ -261,10 +263,10 @@ protected:
     MP4Integer32Property* m_pSttsSampleCountProperty;
     MP4Integer32Property* m_pSttsSampleDeltaProperty;
 
-    // for improve sequental timestamp index access
-    uint32_t    m_cachedSttsIndex;
-    MP4SampleId m_cachedSttsSid;
-    MP4Timestamp    m_cachedSttsElapsed;
+    // first sample id and start time of each stts entry, for binary
+    // search. Extended on demand; only the last entry can still change.
+    MP4Integer32Array m_sttsStartSid;
+    MP4Integer64Array m_sttsStartTime;
 
     uint32_t    m_cachedCttsIndex;
     MP4SampleId m_cachedCttsSid;
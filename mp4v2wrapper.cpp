@@ -2,6 +2,10 @@
 #include "mp4v2wrapper.h"
 #include "strutil.h"
 #include "win32util.h"
+#include <fcntl.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #undef FindAtom // XXX: conflicts with kernel32 function macro
 
 using mp4v2::impl::MP4File;
@@ -87,64 +91,260 @@ public:
     }
 };
 
-namespace myprovider {
+namespace pio {
 
+#ifdef _WIN32
+/*
+ * ReadFile()/WriteFile() with explicit offset work as pread()/pwrite()
+ * on synchronous handles.
+ */
 static
-void *open(const char *name, MP4FileMode mode)
+int64_t pread(int fd, void *buffer, size_t size, int64_t off)
 {
-    return win32::tmpfile(strutil::us2w(name).c_str());
+    HANDLE fh = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+    OVERLAPPED ov = { 0 };
+    ov.Offset = static_cast<DWORD>(off);
+    ov.OffsetHigh = static_cast<DWORD>(off >> 32);
+    DWORD n;
+    if (!ReadFile(fh, buffer, static_cast<DWORD>(size), &n, &ov))
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    return n;
 }
 
 static
-int seek(void *fh, int64_t pos)
+int64_t pwrite(int fd, const void *buffer, size_t size, int64_t off)
 {
-    FILE *fp = reinterpret_cast<FILE*>(fh);
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    return std::fsetpos(fp, static_cast<fpos_t*>(&pos));
+    HANDLE fh = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+    OVERLAPPED ov = { 0 };
+    ov.Offset = static_cast<DWORD>(off);
+    ov.OffsetHigh = static_cast<DWORD>(off >> 32);
+    DWORD n;
+    if (!WriteFile(fh, buffer, static_cast<DWORD>(size), &n, &ov))
+        return -1;
+    return n;
+}
 #else
-    return fseeko(fp, pos, SEEK_SET);
+using ::pread;
+using ::pwrite;
 #endif
-}
 
 static
-int read(void *fh, void *data, int64_t size, int64_t *nc, int64_t)
+bool read_full(int fd, void *buffer, size_t size, int64_t off, size_t *nin)
 {
-    FILE *fp = reinterpret_cast<FILE*>(fh);
-    size_t n = std::fread(data, 1, size, fp);
-    *nc = n;
-    return std::ferror(fp);
+    char *bp = static_cast<char*>(buffer);
+    size_t total = 0;
+    while (total < size) {
+        int64_t n = pread(fd, bp + total, size - total, off + total);
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        total += n;
+    }
+    *nin = total;
+    return true;
 }
 
 static
-int write(void *fh, const void *data, int64_t size, int64_t *nc, int64_t)
+bool write_full(int fd, const void *buffer, size_t size, int64_t off)
 {
-    FILE *fp = reinterpret_cast<FILE*>(fh);
-    size_t n = std::fwrite(data, 1, size, fp);
-    *nc = n;
-    return std::ferror(fp);
+    const char *bp = static_cast<const char*>(buffer);
+    size_t total = 0;
+    while (total < size) {
+        int64_t n = pwrite(fd, bp + total, size - total, off + total);
+        if (n <= 0)
+            return false;
+        total += n;
+    }
+    return true;
 }
 
-static
-int close(void *fh)
+} // namespace pio
+
+PIOFileProvider::PIOFileProvider(int fd, bool temp)
+    : m_fd(fd), m_tmpfp(0), m_owner(false), m_temp(temp),
+      m_drop_cache(false), m_size_hint(0), m_pos(0), m_wbase(0), m_wlen(0)
 {
-    FILE *fp = reinterpret_cast<FILE*>(fh);
-    return std::fclose(fp);
 }
 
-} // namespace myprovider
+bool PIOFileProvider::open(std::string name, Mode mode)
+{
+    if (m_fd < 0 && m_temp) {
+#ifdef _WIN32
+        try {
+            m_tmpfp = win32::tmpfile(strutil::us2w(name).c_str());
+        } catch (...) {
+            return true;
+        }
+#else
+        if (!(m_tmpfp = std::tmpfile()))
+            return true;
+#endif
+        m_fd = fileno(m_tmpfp);
+    } else if (m_fd < 0) {
+        int flags;
+        switch (mode) {
+        case MODE_MODIFY: flags = O_RDWR; break;
+        case MODE_CREATE: flags = O_RDWR | O_CREAT | O_TRUNC; break;
+        default:          flags = O_RDONLY; break;
+        }
+#ifdef _WIN32
+        m_fd = _wopen(win32::prefixed_path(strutil::us2w(name).c_str()).c_str(),
+                      flags | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        m_fd = ::open(name.c_str(), flags, 0666);
+#endif
+        if (m_fd < 0)
+            return true;
+        m_owner = true;
+    }
+    m_pos = 0;
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (mode != MODE_CREATE)
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#if defined(__linux__)
+    /* reserve blocks, but leave the file size as is */
+    if (mode == MODE_CREATE && m_size_hint > 0)
+        fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, m_size_hint);
+#endif
+    return false;
+}
 
+bool PIOFileProvider::seek(Size pos)
+{
+    m_pos = pos;
+    return false;
+}
 
-void MP4FileX::CreateTemp(const char *prefix,
+bool PIOFileProvider::read(void *buffer, Size size, Size &nin, Size)
+{
+    if (m_wlen && flush())
+        return true;
+    size_t n;
+    if (!pio::read_full(m_fd, buffer, size, m_pos, &n))
+        return true;
+    m_pos += n;
+    nin = n;
+    return false;
+}
+
+bool PIOFileProvider::write(const void *buffer, Size size, Size &nout, Size)
+{
+    if (m_wlen && m_pos != m_wbase + static_cast<int64_t>(m_wlen)
+        && flush())
+        return true;
+    if (m_wlen + size > WRITE_BUFFER_SIZE && flush())
+        return true;
+    if (size >= WRITE_BUFFER_SIZE) {
+        if (!pio::write_full(m_fd, buffer, size, m_pos))
+            return true;
+    } else {
+        if (m_wbuf.size() < WRITE_BUFFER_SIZE)
+            m_wbuf.resize(WRITE_BUFFER_SIZE);
+        if (!m_wlen)
+            m_wbase = m_pos;
+        std::memcpy(&m_wbuf[m_wlen], buffer, size);
+        m_wlen += size;
+    }
+    m_pos += size;
+    nout = size;
+    return false;
+}
+
+bool PIOFileProvider::flush()
+{
+    if (!m_wlen)
+        return false;
+    if (!pio::write_full(m_fd, &m_wbuf[0], m_wlen, m_wbase))
+        return true;
+#if defined(POSIX_FADV_DONTNEED)
+    if (m_drop_cache)
+        posix_fadvise(m_fd, m_wbase, m_wlen, POSIX_FADV_DONTNEED);
+#endif
+    m_wlen = 0;
+    return false;
+}
+
+bool PIOFileProvider::close()
+{
+    if (m_fd < 0)
+        return false;
+    bool err = flush();
+    if (m_tmpfp)
+        err |= std::fclose(m_tmpfp) != 0;
+    else if (m_owner)
+        err |= ::close(m_fd) != 0;
+    m_fd = -1;
+    m_tmpfp = 0;
+    m_owner = false;
+    return err;
+}
+
+void *MP4PIOProvider::open(const char *name, MP4FileMode mode)
+{
+    PIOFileProvider *p = new PIOFileProvider();
+    if (p->open(name, static_cast<File::Mode>(mode))) {
+        delete p;
+        return 0;
+    }
+    return p;
+}
+
+void *MP4PIOProvider::openTemp(const char *name, MP4FileMode mode)
+{
+    PIOFileProvider *p = new PIOFileProvider(-1, true);
+    if (p->open(name, static_cast<File::Mode>(mode))) {
+        delete p;
+        return 0;
+    }
+    return p;
+}
+
+void *MP4FDReadProvider::openFD(const char *name, MP4FileMode mode)
+{
+    PIOFileProvider *p =
+        new PIOFileProvider(std::strtol(name, 0, 10));
+    p->open(name, File::MODE_READ);
+    return p;
+}
+
+int MP4PIOProvider::seek(void *handle, int64_t pos)
+{
+    return static_cast<PIOFileProvider*>(handle)->seek(pos);
+}
+
+int MP4PIOProvider::read(void *handle, void *buffer, int64_t size,
+                         int64_t *nin, int64_t maxChunkSize)
+{
+    return static_cast<PIOFileProvider*>(handle)->read(buffer, size, *nin,
+                                                       maxChunkSize);
+}
+
+int MP4PIOProvider::write(void *handle, const void *buffer, int64_t size,
+                          int64_t *nout, int64_t maxChunkSize)
+{
+    return static_cast<PIOFileProvider*>(handle)->write(buffer, size, *nout,
+                                                        maxChunkSize);
+}
+
+int MP4PIOProvider::close(void *handle)
+{
+    PIOFileProvider *p = static_cast<PIOFileProvider*>(handle);
+    int rc = p->close();
+    delete p;
+    return rc;
+}
+
+
+void MP4FileX::CreateWithProvider(const char *name,
+            const MP4FileProvider *provider,
             uint32_t flags, int add_ftyp, int add_iods,
             char *majorBrand, uint32_t minorVersion,
             char **supportedBrands, uint32_t supportedBrandsCount)
 {
-    MP4FileProvider provider = {
-        myprovider::open, myprovider::seek, myprovider::read,
-        myprovider::write, myprovider::close
-    };
     m_createFlags = flags;
-    Open(prefix, File::MODE_CREATE, &provider);
+    Open(name, File::MODE_CREATE, provider);
 
     m_pRootAtom = MP4Atom::CreateAtom(*this, NULL, NULL);
     m_pRootAtom->Generate();
@@ -158,6 +358,28 @@ void MP4FileX::CreateTemp(const char *prefix,
     if (add_iods != 0) (void)AddChildAtom("moov", "iods");
 }
 
+void MP4FileX::CreateX(const char *fileName,
+            uint32_t flags, int add_ftyp, int add_iods,
+            char *majorBrand, uint32_t minorVersion,
+            char **supportedBrands, uint32_t supportedBrandsCount)
+{
+    MP4PIOProvider provider;
+    CreateWithProvider(fileName, &provider, flags, add_ftyp, add_iods,
+                       majorBrand, minorVersion,
+                       supportedBrands, supportedBrandsCount);
+}
+
+void MP4FileX::CreateTemp(const char *prefix,
+            uint32_t flags, int add_ftyp, int add_iods,
+            char *majorBrand, uint32_t minorVersion,
+            char **supportedBrands, uint32_t supportedBrandsCount)
+{
+    MP4PIOProvider provider(true);
+    CreateWithProvider(prefix, &provider, flags, add_ftyp, add_iods,
+                       majorBrand, minorVersion,
+                       supportedBrands, supportedBrandsCount);
+}
+
 MP4TrackId
 MP4FileX::AddAlacAudioTrack(const uint8_t *alac, const uint8_t *chan)
 {
@@ -445,14 +667,21 @@ MP4FileCopy::MP4FileCopy(MP4File *file)
 
 void MP4FileCopy::start(const char *path)
 {
-    m_mp4file->m_file = 0;
-    try {
-        m_mp4file->Open(path, File::MODE_CREATE, 0);
-    } catch (...) {
+    uint64_t total = 0;
+    size_t numTracks = m_mp4file->GetNumberOfTracks();
+    for (size_t i = 0; i < numTracks; ++i)
+        total += m_mp4file->m_pTracks[i]->GetTotalOfSampleSizes();
+
+    PIOFileProvider *provider = new PIOFileProvider();
+    provider->setSizeHint(total);
+    provider->setDropCache(true);
+    File *file = new File(path, File::MODE_CREATE, provider);
+    if (file->open()) {
+        delete file;
         m_mp4file->ResetFile();
-        throw;
+        throw std::runtime_error(strutil::format("open(%s) failed", path));
     }
-    m_dst = m_mp4file->m_file;
+    m_mp4file->m_file = m_dst = file;
     m_mp4file->SetIntegerProperty("moov.mvhd.modificationTime",
         mp4v2::impl::MP4GetAbsTimestamp());
     dynamic_cast<MP4RootAtom*>(m_mp4file->m_pRootAtom)->BeginOptimalWrite();
@@ -465,6 +694,8 @@ void MP4FileCopy::finish()
     try {
         MP4RootAtom *root = dynamic_cast<MP4RootAtom*>(m_mp4file->m_pRootAtom);
         root->FinishOptimalWrite();
+        if (m_dst->close())
+            throw std::runtime_error("MP4FileCopy: write failed");
     } catch (...) {
         delete m_src;
         delete m_dst;
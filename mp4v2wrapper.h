@@ -2,6 +2,7 @@
 #define MP4V2WRAPPER_H
 
 #include <string>
+#include <vector>
 #include <stdexcept>
 #include <stdint.h>
 #undef FindAtom
@@ -27,6 +28,12 @@ public:
 
     void ResetFile() { m_file = 0; }
 
+    /* same as Create(), but through PIOFileProvider */
+    void CreateX(const char *fileName,
+            uint32_t flags, int add_ftyp, int add_iods,
+            char *majorBrand, uint32_t minorVersion,
+            char **supportedBrands, uint32_t supportedBrandsCount);
+
     void CreateTemp(const char *prefix,
             uint32_t flags, int add_ftyp, int add_iods,
             char *majorBrand, uint32_t minorVersion,
@@ -76,6 +83,11 @@ public:
     bool MP4FileX::GetNeroChapters(std::vector<chapters::entry_t> *chapters);
     bool MP4FileX::GetChapters(std::vector<chapters::entry_t> *chapters);
 protected:
+    void CreateWithProvider(const char *name,
+            const MP4FileProvider *provider,
+            uint32_t flags, int add_ftyp, int add_iods,
+            char *majorBrand, uint32_t minorVersion,
+            char **supportedBrands, uint32_t supportedBrandsCount);
     mp4v2::impl::MP4DataAtom *CreateMetadataAtom(const char *name,
             mp4v2::impl::itmf::BasicType typeCode);
     mp4v2::impl::MP4DataAtom *FindOrCreateMetadataAtom(const char *atom,
@@ -101,45 +113,84 @@ public:
     uint64_t getTotalChunks() { return m_nchunks; }
 };
 
-struct MP4FDReadProvider: public MP4FileProvider
+/*
+ * FileProvider on a raw file descriptor, using positional I/O.
+ * seek() only moves our own file pointer, and writes are collected into
+ * a large write-behind buffer, so that mp4v2's many small atom/sample
+ * writes reach the disk as a few big contiguous ones.
+ */
+class PIOFileProvider: public mp4v2::platform::io::FileProvider {
+    int m_fd;
+    FILE *m_tmpfp;
+    bool m_owner;
+    bool m_temp;
+    bool m_drop_cache;
+    int64_t m_size_hint;
+    int64_t m_pos;
+    int64_t m_wbase;
+    size_t m_wlen;
+    std::vector<char> m_wbuf;
+public:
+    enum { WRITE_BUFFER_SIZE = 0x400000 };
+
+    /*
+     * fd >= 0: use given descriptor (not owned, not closed)
+     * temp: name passed to open() is a prefix for a new temporary file
+     */
+    explicit PIOFileProvider(int fd=-1, bool temp=false);
+    ~PIOFileProvider() { close(); }
+
+    /* preallocate this many bytes on open (MODE_CREATE only) */
+    void setSizeHint(int64_t size) { m_size_hint = size; }
+    /* don't keep written data in page cache */
+    void setDropCache(bool value) { m_drop_cache = value; }
+
+    bool open(std::string name, Mode mode);
+    bool seek(Size pos);
+    bool read(void *buffer, Size size, Size &nin, Size maxChunkSize);
+    bool write(const void *buffer, Size size, Size &nout, Size maxChunkSize);
+    bool close();
+private:
+    bool flush();
+};
+
+/*
+ * C style MP4FileProvider bridging to PIOFileProvider, for the
+ * mp4v2 API taking MP4FileProvider.
+ */
+struct MP4PIOProvider: public MP4FileProvider
 {
-    MP4FDReadProvider()
+    explicit MP4PIOProvider(bool temp=false)
     {
         static MP4FileProvider t = {
-            open, seek, read, 0, close
+            open, seek, read, write, close
         };
-        std::memset(this, 0, sizeof t);
         std::memcpy(this, &t, sizeof t);
+        if (temp) MP4FileProvider::open = openTemp;
     }
-
-    static void *open(const char *name, MP4FileMode mode)
-    {
-        /*
-         * file descriptor (in the form of text string) is get passed as
-         * "name". We decode it to an integer, and use it as a handle.
-         * Since returning zero is treated as error on mp4v2 side,
-         * we cannot use fd 0 (stdin) as handle. So we add 1 to it here,
-         * and substruct by 1 on the succeeding jobs.
-         */
-        int fd = std::strtol(name, 0, 10);
-        return reinterpret_cast<void*>(fd + 1);
-    }
-    static int seek(void *handle, int64_t pos)
-    {
-        int fd = reinterpret_cast<int>(handle) - 1;
-        return _lseeki64(fd, pos, SEEK_SET) < 0;
-    }
+    static void *open(const char *name, MP4FileMode mode);
+    static void *openTemp(const char *name, MP4FileMode mode);
+    static int seek(void *handle, int64_t pos);
     static int read(void *handle, void *buffer, int64_t size, int64_t *nin,
-                    int64_t maxChunkSize)
-    {
-        int fd = reinterpret_cast<int>(handle) - 1;
-        *nin = util::nread(fd, buffer, size);
-        return *nin < 0;
-    }
-    static int close(void *handle)
+                    int64_t maxChunkSize);
+    static int write(void *handle, const void *buffer, int64_t size,
+                     int64_t *nout, int64_t maxChunkSize);
+    static int close(void *handle);
+};
+
+struct MP4FDReadProvider: public MP4PIOProvider
+{
+    MP4FDReadProvider()
     {
-        return 0;
+        MP4FileProvider::open = openFD;
+        MP4FileProvider::write = 0;
     }
+
+    /*
+     * file descriptor (in the form of text string) is get passed as
+     * "name". The descriptor is owned by the caller and is left open.
+     */
+    static void *openFD(const char *name, MP4FileMode mode);
 };
 
 #endif
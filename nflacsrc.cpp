@@ -0,0 +1,754 @@
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "nflacsrc.h"
+#include "flacsrc.h"
+#include "cautil.h"
+#include "win32util.h"
+
+namespace nflac {
+    const unsigned MAX_HEADER_SIZE = 16;
+    const size_t INPUT_BUFFER_SIZE = 0x40000;
+    /* seeking bisects by frame sync until the range gets this small */
+    const int64_t BISECT_THRESHOLD = 0x10000;
+
+    inline void want(bool expr)
+    {
+        if (!expr)
+            throw std::runtime_error("Sorry, unacceptable FLAC format");
+    }
+
+    inline void check(bool expr)
+    {
+        if (!expr)
+            throw std::runtime_error("FLAC decoder error");
+    }
+
+    inline unsigned clz64(uint64_t v)
+    {
+#ifdef _MSC_VER
+        unsigned long n;
+        if (_BitScanReverse(&n, static_cast<uint32_t>(v >> 32)))
+            return 31 - n;
+        _BitScanReverse(&n, static_cast<uint32_t>(v));
+        return 63 - n;
+#else
+        return __builtin_clzll(v);
+#endif
+    }
+
+    inline uint32_t get24(const uint8_t *p)
+    {
+        return (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+    inline uint32_t get32(const uint8_t *p)
+    {
+        return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    inline uint64_t get64(const uint8_t *p)
+    {
+        return (static_cast<uint64_t>(get32(p)) << 32) | get32(p + 4);
+    }
+    inline uint32_t get32le(const uint8_t *p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+    }
+
+    struct CRCTable {
+        uint8_t crc8[256];
+        uint16_t crc16[256];
+        CRCTable()
+        {
+            for (unsigned i = 0; i < 256; ++i) {
+                unsigned c8 = i, c16 = i << 8;
+                for (int n = 0; n < 8; ++n) {
+                    c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+                    c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+                }
+                crc8[i] = c8 & 0xff;
+                crc16[i] = c16 & 0xffff;
+            }
+        }
+    } crc_table;
+
+    unsigned crc8(const uint8_t *p, size_t n)
+    {
+        unsigned crc = 0;
+        while (n--)
+            crc = crc_table.crc8[crc ^ *p++];
+        return crc;
+    }
+
+    unsigned crc16(const uint8_t *p, size_t n)
+    {
+        unsigned crc = 0;
+        while (n--)
+            crc = ((crc << 8) & 0xffff) ^ crc_table.crc16[(crc >> 8) ^ *p++];
+        return crc;
+    }
+
+    void restore_fixed(unsigned order, unsigned n, int32_t *d)
+    {
+        switch (order) {
+        case 1:
+            for (unsigned i = 1; i < n; ++i)
+                d[i] += d[i-1];
+            break;
+        case 2:
+            for (unsigned i = 2; i < n; ++i)
+                d[i] += 2 * d[i-1] - d[i-2];
+            break;
+        case 3:
+            for (unsigned i = 3; i < n; ++i)
+                d[i] += 3 * (d[i-1] - d[i-2]) + d[i-3];
+            break;
+        case 4:
+            for (unsigned i = 4; i < n; ++i)
+                d[i] += 4 * (d[i-1] + d[i-3]) - 6 * d[i-2] - d[i-4];
+            break;
+        }
+    }
+
+    /*
+     * Same as libFLAC, 32bit accumulator is used when it cannot overflow
+     * on valid streams (wrapping as libFLAC does otherwise), and 64bit
+     * accumulator is used for the rest.
+     */
+    inline int32_t quantize(uint32_t sum, int shift)
+    {
+        return static_cast<int32_t>(sum) >> shift;
+    }
+    inline int32_t quantize(int64_t sum, int shift)
+    {
+        return static_cast<int32_t>(sum >> shift);
+    }
+
+    /* fixed order version, fully unrolled by the compiler */
+    template <typename T, unsigned N>
+    void restore_lpc(const int32_t *coefs, int shift, unsigned n, int32_t *d)
+    {
+        T c[N];
+        for (unsigned j = 0; j < N; ++j)
+            c[j] = static_cast<T>(coefs[j]);
+        for (unsigned i = N; i < n; ++i) {
+            T sum = 0;
+            for (unsigned j = 0; j < N; ++j)
+                sum += c[j] * static_cast<T>(d[i - 1 - j]);
+            d[i] += quantize(sum, shift);
+        }
+    }
+
+    template <typename T>
+    void restore_lpc(const int32_t *coefs, unsigned order, int shift,
+                     unsigned n, int32_t *d)
+    {
+        switch (order) {
+#define CASE(N) case N: restore_lpc<T, N>(coefs, shift, n, d); return;
+        CASE(1) CASE(2) CASE(3) CASE(4) CASE(5) CASE(6)
+        CASE(7) CASE(8) CASE(9) CASE(10) CASE(11) CASE(12)
+#undef CASE
+        }
+        for (unsigned i = order; i < n; ++i) {
+            T sum = 0;
+            for (unsigned j = 0; j < order; ++j)
+                sum += static_cast<T>(coefs[j]) * static_cast<T>(d[i - 1 - j]);
+            d[i] += quantize(sum, shift);
+        }
+    }
+
+    inline unsigned ilog2(unsigned v)
+    {
+        unsigned n = 0;
+        while (v >>= 1) ++n;
+        return n;
+    }
+}
+
+NativeFLACSource::NativeFLACSource(const std::shared_ptr<FILE> &fp)
+    : m_min_blocksize(0),
+      m_max_blocksize(0),
+      m_max_framesize(0),
+      m_length(0),
+      m_position(0),
+      m_next_sample(0),
+      m_fp(fp),
+      m_input_offset(0),
+      m_input_end(0),
+      m_bitpos(0),
+      m_bitlimit(0),
+      m_input_eof(false)
+{
+    std::memset(&m_asbd, 0, sizeof m_asbd);
+    parseMetadata();
+    m_first_frame = _lseeki64(fd(), 0, SEEK_CUR);
+    m_file_length = _filelengthi64(fd());
+    m_input_offset = m_first_frame;
+    m_buffer.units_per_packet = m_asbd.mChannelsPerFrame;
+}
+
+size_t NativeFLACSource::readSamples(void *buffer, size_t nsamples)
+{
+    uint32_t nchannels = m_asbd.mChannelsPerFrame;
+    int32_t *bp = static_cast<int32_t*>(buffer);
+    size_t done = 0;
+    while (done < nsamples) {
+        if (!m_buffer.count()) {
+            FrameHeader h;
+            if (!decodeFrame(&h))
+                break;
+            /* whole frame fits, decode directly into the caller's buffer */
+            if (h.blocksize <= nsamples - done) {
+                interleave(h.blocksize, bp + done * nchannels);
+                done += h.blocksize;
+                continue;
+            }
+            m_buffer.resize(h.blocksize);
+            m_buffer.commit(h.blocksize);
+            interleave(h.blocksize, m_buffer.write_ptr());
+        }
+        size_t count = std::min(static_cast<size_t>(m_buffer.count()),
+                                nsamples - done);
+        std::memcpy(bp + done * nchannels, m_buffer.read_ptr(),
+                    count * nchannels * 4);
+        m_buffer.advance(count);
+        done += count;
+    }
+    m_position += done;
+    return done;
+}
+
+void NativeFLACSource::seekTo(int64_t count)
+{
+    if (count == m_position)
+        return;
+    m_buffer.reset();
+    uint64_t target = count;
+
+    /* narrow the range with seek table first */
+    int64_t lo = m_first_frame, hi = m_file_length;
+    uint64_t lo_sample = 0;
+    for (size_t i = 0; i < m_seektable.size(); ++i) {
+        const SeekPoint &sp = m_seektable[i];
+        int64_t offset = m_first_frame + sp.offset;
+        if (offset >= m_file_length)
+            break;
+        if (sp.sample > target) {
+            hi = offset;
+            break;
+        }
+        lo = offset;
+        lo_sample = sp.sample;
+    }
+    /* seek points and the first frame are known frame boundaries */
+    int64_t start = lo;
+    uint64_t start_sample = lo_sample;
+    while (hi - lo > nflac::BISECT_THRESHOLD) {
+        int64_t mid = lo + (hi - lo) / 2;
+        FrameHeader h;
+        setInputPosition(mid);
+        if (!syncFrame(&h) || inputPosition() >= hi || h.sample > target)
+            hi = mid;
+        else {
+            lo = inputPosition();
+            lo_sample = h.sample;
+        }
+    }
+    setInputPosition(lo);
+    m_next_sample = lo_sample;
+
+    /*
+     * then decode forward to the target.
+     * A frame found by bisection has passed only the header CRC-8, and
+     * can be a false sync in the middle of frame data. When it fails to
+     * decode, resync from the next byte, or start over from the known
+     * boundary if the next sync is already past the target.
+     */
+    bool verified = lo == start;
+    FrameHeader h;
+    for (;;) {
+        int64_t pos = inputPosition();
+        try {
+            if (!decodeFrame(&h))
+                break;
+        } catch (const std::runtime_error &) {
+            if (verified)
+                throw;
+            setInputPosition(pos + 1);
+            if (syncFrame(&h) && h.sample <= target)
+                m_next_sample = h.sample;
+            else {
+                setInputPosition(start);
+                m_next_sample = start_sample;
+                verified = true;
+            }
+            continue;
+        }
+        verified = true;
+        if (h.sample + h.blocksize > target) {
+            m_buffer.resize(h.blocksize);
+            m_buffer.commit(h.blocksize);
+            interleave(h.blocksize, m_buffer.write_ptr());
+            if (target > h.sample)
+                m_buffer.advance(static_cast<uint32_t>(target - h.sample));
+            break;
+        }
+    }
+    m_position = count;
+}
+
+void NativeFLACSource::parseMetadata()
+{
+    uint8_t buffer[10];
+    util::check_eof(util::nread(fd(), buffer, 4) == 4);
+    if (std::memcmp(buffer, "ID3", 3) == 0) {
+        util::check_eof(util::nread(fd(), buffer + 4, 6) == 6);
+        uint32_t size = 0;
+        for (int i = 6; i < 10; ++i) {
+            size <<= 7;
+            size |= buffer[i] & 0x7f;
+        }
+        if (buffer[5] & 0x10)
+            size += 10;
+        CHECKCRT(_lseeki64(fd(), 10 + size, SEEK_SET) < 0);
+        util::check_eof(util::nread(fd(), buffer, 4) == 4);
+    }
+    if (std::memcmp(buffer, "fLaC", 4))
+        throw std::runtime_error("Not a FLAC file");
+
+    std::vector<uint8_t> block;
+    bool last = false;
+    bool has_streaminfo = false;
+    while (!last) {
+        util::check_eof(util::nread(fd(), buffer, 4) == 4);
+        last = (buffer[0] & 0x80) != 0;
+        unsigned type = buffer[0] & 0x7f;
+        uint32_t size = nflac::get24(buffer + 1);
+        if (type != 0 && type != 3 && type != 4) {
+            CHECKCRT(_lseeki64(fd(), size, SEEK_CUR) < 0);
+            continue;
+        }
+        block.resize(size + 1);
+        util::check_eof(util::nread(fd(), &block[0], size) ==
+                        static_cast<ssize_t>(size));
+        if (type == 0) {
+            parseStreamInfo(&block[0], size);
+            has_streaminfo = true;
+        } else if (type == 3)
+            parseSeekTable(&block[0], size);
+        else if (type == 4 && has_streaminfo)
+            parseVorbisComment(&block[0], size);
+    }
+    nflac::want(has_streaminfo);
+}
+
+void NativeFLACSource::parseStreamInfo(const uint8_t *p, size_t size)
+{
+    nflac::want(size >= 34);
+    m_min_blocksize = (p[0] << 8) | p[1];
+    m_max_blocksize = (p[2] << 8) | p[3];
+    m_max_framesize = nflac::get24(p + 7);
+    uint32_t sample_rate = (p[10] << 12) | (p[11] << 4) | (p[12] >> 4);
+    unsigned channels = ((p[12] >> 1) & 7) + 1;
+    unsigned bps = (((p[12] & 1) << 4) | (p[13] >> 4)) + 1;
+    m_length = (static_cast<uint64_t>(p[13] & 0xf) << 32)
+             | nflac::get32(p + 14);
+    if (!m_length)
+        m_length = ~0ULL;
+
+    nflac::want(sample_rate > 0);
+    nflac::want(bps >= 8 && bps <= 24);
+    nflac::want(m_max_blocksize >= 16);
+    m_asbd = cautil::buildASBDForPCM2(sample_rate, channels, bps, 32,
+                                      kAudioFormatFlagIsSignedInteger);
+}
+
+void NativeFLACSource::parseSeekTable(const uint8_t *p, size_t size)
+{
+    for (size_t i = 0; i + 18 <= size; i += 18) {
+        SeekPoint sp;
+        sp.sample = nflac::get64(p + i);
+        sp.offset = nflac::get64(p + i + 8);
+        /* placeholder */
+        if (sp.sample == ~0ULL)
+            continue;
+        m_seektable.push_back(sp);
+    }
+}
+
+void NativeFLACSource::parseVorbisComment(const uint8_t *p, size_t size)
+{
+    std::vector<std::string> comments;
+    const uint8_t *end = p + size;
+    if (end - p < 4)
+        return;
+    uint32_t len = nflac::get32le(p);
+    p += 4;
+    if (static_cast<size_t>(end - p) < len)
+        return;
+    p += len;
+    if (end - p < 4)
+        return;
+    uint32_t count = nflac::get32le(p);
+    p += 4;
+    for (uint32_t i = 0; i < count && end - p >= 4; ++i) {
+        len = nflac::get32le(p);
+        p += 4;
+        if (static_cast<size_t>(end - p) < len)
+            break;
+        comments.push_back(std::string(p, p + len));
+        p += len;
+    }
+    double duration = m_length == ~0ULL ? 0 : m_length / m_asbd.mSampleRate;
+    flac::parseVorbisComments(comments, duration, &m_tags, &m_chapters,
+                              &m_chanmap);
+}
+
+bool NativeFLACSource::decodeFrame(FrameHeader *h)
+{
+    if (m_length != ~0ULL && m_next_sample >= m_length)
+        return false;
+    unsigned nchannels = m_asbd.mChannelsPerFrame;
+    unsigned bps = m_asbd.mBitsPerChannel;
+    size_t need = m_max_framesize;
+    if (!need)
+        need = m_max_blocksize * nchannels * 4 + nflac::MAX_HEADER_SIZE;
+
+    for (;;) {
+        fill(need);
+        size_t start = m_bitpos >> 3;
+        if (start >= m_input_end)
+            return false;
+        if (!parseFrameHeader(start, h)) {
+            /* trailing garbage is ignored, lost sync in the middle is not */
+            if (!syncFrame(h))
+                return false;
+            throw std::runtime_error("FLAC decoder error: lost sync");
+        }
+        try {
+            m_bitpos += h->size * 8;
+            if (m_planar.size() < h->blocksize * nchannels)
+                m_planar.resize(h->blocksize * nchannels);
+            for (unsigned n = 0; n < nchannels; ++n) {
+                /* side channel has one more bit */
+                unsigned sbps = bps;
+                if ((h->assignment == 8 || h->assignment == 10) && n == 1)
+                    ++sbps;
+                else if (h->assignment == 9 && n == 0)
+                    ++sbps;
+                decodeSubframe(sbps, h->blocksize,
+                               &m_planar[n * h->blocksize]);
+            }
+            m_bitpos = (m_bitpos + 7) & ~7;
+            unsigned crc = bits(16);
+            if (m_bitpos > m_bitlimit)
+                throw BufferUnderrun();
+            size_t end = m_bitpos >> 3;
+            if (nflac::crc16(&m_input[start], end - start - 2) != crc)
+                throw std::runtime_error("FLAC decoder error: CRC mismatch");
+            break;
+        } catch (const BufferUnderrun &) {
+            if (m_input_eof)
+                throw std::runtime_error("FLAC decoder error: "
+                                         "unexpected end of file");
+            /* frame larger than expected, retry with larger buffer */
+            m_bitpos = start << 3;
+            need = (m_input_end - start) * 2;
+        }
+    }
+
+    int32_t *l = &m_planar[0];
+    int32_t *r = &m_planar[h->blocksize];
+    switch (h->assignment) {
+    case 8: /* left/side */
+        for (unsigned i = 0; i < h->blocksize; ++i)
+            r[i] = l[i] - r[i];
+        break;
+    case 9: /* side/right */
+        for (unsigned i = 0; i < h->blocksize; ++i)
+            l[i] += r[i];
+        break;
+    case 10: /* mid/side */
+        for (unsigned i = 0; i < h->blocksize; ++i) {
+            int32_t side = r[i];
+            int32_t mid = (static_cast<uint32_t>(l[i]) << 1) | (side & 1);
+            l[i] = (mid + side) >> 1;
+            r[i] = (mid - side) >> 1;
+        }
+        break;
+    }
+    m_next_sample = h->sample + h->blocksize;
+    return true;
+}
+
+bool NativeFLACSource::parseFrameHeader(size_t pos, FrameHeader *h)
+{
+    if (m_input_end - pos < 6)
+        return false;
+    const uint8_t *p = &m_input[pos];
+    if (p[0] != 0xff || (p[1] & 0xfe) != 0xf8)
+        return false;
+    bool variable = (p[1] & 1) != 0;
+    unsigned bs_code = p[2] >> 4;
+    unsigned sr_code = p[2] & 0xf;
+    unsigned assignment = p[3] >> 4;
+    unsigned ss_code = (p[3] >> 1) & 7;
+    if (!bs_code || sr_code == 15 || assignment > 10 || (p[3] & 1))
+        return false;
+    if (ss_code == 3 || ss_code == 7)
+        return false;
+
+    /* sample/frame number in UTF-8 like coding */
+    unsigned n = 4;
+    uint64_t number = p[n++];
+    unsigned extra = 0;
+    if (number >= 0x80) {
+        if (number >= 0xfe) {
+            if (number == 0xff)
+                return false;
+            extra = 6;
+            number = 0;
+        } else {
+            extra = nflac::clz64(~(number << 56)) - 1;
+            if (extra < 1)
+                return false;
+            number &= 0x7f >> (extra + 1);
+        }
+    }
+    if (n + extra + 4 + 1 > m_input_end - pos)
+        return false;
+    for (unsigned i = 0; i < extra; ++i) {
+        if ((p[n] & 0xc0) != 0x80)
+            return false;
+        number = (number << 6) | (p[n++] & 0x3f);
+    }
+
+    unsigned blocksize;
+    if (bs_code == 1)
+        blocksize = 192;
+    else if (bs_code <= 5)
+        blocksize = 576 << (bs_code - 2);
+    else if (bs_code == 6)
+        blocksize = p[n++] + 1;
+    else if (bs_code == 7) {
+        blocksize = ((p[n] << 8) | p[n+1]) + 1;
+        n += 2;
+    } else
+        blocksize = 256 << (bs_code - 8);
+
+    static const uint32_t rates[] = {
+        0, 88200, 176400, 192000, 8000, 16000, 22050, 24000,
+        32000, 44100, 48000, 96000
+    };
+    uint32_t rate;
+    if (sr_code == 0)
+        rate = static_cast<uint32_t>(m_asbd.mSampleRate);
+    else if (sr_code < 12)
+        rate = rates[sr_code];
+    else if (sr_code == 12)
+        rate = p[n++] * 1000;
+    else {
+        rate = (p[n] << 8) | p[n+1];
+        if (sr_code == 14)
+            rate *= 10;
+        n += 2;
+    }
+    if (nflac::crc8(p, n) != p[n])
+        return false;
+    ++n;
+
+    static const unsigned sizes[] = { 0, 8, 12, 0, 16, 20, 24, 0 };
+    unsigned bps = ss_code ? sizes[ss_code] : m_asbd.mBitsPerChannel;
+    unsigned nchannels = assignment < 8 ? assignment + 1 : 2;
+    if (nchannels != m_asbd.mChannelsPerFrame
+     || rate != m_asbd.mSampleRate
+     || bps != m_asbd.mBitsPerChannel)
+        return false;
+
+    h->blocksize = blocksize;
+    h->assignment = assignment;
+    h->size = n;
+    /* frame number counts min_blocksize blocks, as libFLAC does */
+    h->sample = variable ? number : number * m_min_blocksize;
+    return true;
+}
+
+/*
+ * Search for the next frame from the current position.
+ * On success, input is positioned at the start of the frame.
+ */
+bool NativeFLACSource::syncFrame(FrameHeader *h)
+{
+    for (;;) {
+        fill(nflac::MAX_HEADER_SIZE);
+        size_t pos = m_bitpos >> 3;
+        if (pos >= m_input_end)
+            return false;
+        const uint8_t *p = &m_input[pos];
+        const uint8_t *q = static_cast<const uint8_t*>(
+                std::memchr(p, 0xff, m_input_end - pos));
+        if (!q)
+            m_bitpos = m_input_end << 3;
+        else if (q != p)
+            m_bitpos = (q - &m_input[0]) << 3;
+        else if (parseFrameHeader(pos, h))
+            return true;
+        else
+            m_bitpos += 8;
+    }
+}
+
+void NativeFLACSource::decodeSubframe(unsigned bps, unsigned blocksize,
+                                      int32_t *out)
+{
+    nflac::check(bits(1) == 0);
+    unsigned type = bits(6);
+    unsigned wasted = 0;
+    if (bits(1)) {
+        wasted = unary() + 1;
+        nflac::check(wasted < bps);
+        bps -= wasted;
+    }
+    if (type == 0) {
+        int32_t v = sbits(bps);
+        std::fill(out, out + blocksize, v);
+    } else if (type == 1) {
+        for (unsigned i = 0; i < blocksize; ++i)
+            out[i] = sbits(bps);
+    } else if (type >= 8 && type <= 12) {
+        unsigned order = type - 8;
+        nflac::check(order <= blocksize);
+        for (unsigned i = 0; i < order; ++i)
+            out[i] = sbits(bps);
+        decodeResidual(order, blocksize, out);
+        nflac::restore_fixed(order, blocksize, out);
+    } else if (type >= 32) {
+        unsigned order = type - 31;
+        nflac::check(order <= blocksize);
+        for (unsigned i = 0; i < order; ++i)
+            out[i] = sbits(bps);
+        unsigned precision = bits(4);
+        nflac::check(precision != 15);
+        ++precision;
+        int shift = sbits(5);
+        nflac::check(shift >= 0);
+        int32_t coefs[32];
+        for (unsigned i = 0; i < order; ++i)
+            coefs[i] = sbits(precision);
+        decodeResidual(order, blocksize, out);
+        if (bps + precision + nflac::ilog2(order) <= 32)
+            nflac::restore_lpc<uint32_t>(coefs, order, shift, blocksize, out);
+        else
+            nflac::restore_lpc<int64_t>(coefs, order, shift, blocksize, out);
+    } else
+        nflac::check(false);
+
+    if (wasted) {
+        for (unsigned i = 0; i < blocksize; ++i)
+            out[i] = static_cast<uint32_t>(out[i]) << wasted;
+    }
+}
+
+void NativeFLACSource::decodeResidual(unsigned order, unsigned blocksize,
+                                      int32_t *out)
+{
+    unsigned method = bits(2);
+    nflac::check(method < 2);
+    unsigned param_bits = method ? 5 : 4;
+    unsigned escape = method ? 31 : 15;
+    unsigned partition_order = bits(4);
+    unsigned psize = blocksize >> partition_order;
+    nflac::check((psize << partition_order) == blocksize && psize >= order);
+
+    int32_t *dp = out + order;
+    for (unsigned i = 0; i < (1u << partition_order); ++i) {
+        unsigned n = i ? psize : psize - order;
+        unsigned k = bits(param_bits);
+        if (k == escape) {
+            unsigned nbits = bits(5);
+            for (unsigned j = 0; j < n; ++j)
+                *dp++ = sbits(nbits);
+            continue;
+        }
+        for (unsigned j = 0; j < n; ++j) {
+            uint64_t v = peek();
+            uint32_t u;
+            unsigned q;
+            if (v && (q = nflac::clz64(v)) + 1 + k <= 57) {
+                u = q << k;
+                if (k)
+                    u |= static_cast<uint32_t>((v << (q + 1)) >> (64 - k));
+                m_bitpos += q + 1 + k;
+            } else {
+                q = unary();
+                u = (q << k) | bits(k);
+            }
+            *dp++ = static_cast<int32_t>(u >> 1) ^ -static_cast<int32_t>(u & 1);
+        }
+    }
+}
+
+void NativeFLACSource::interleave(unsigned blocksize, int32_t *dst)
+{
+    unsigned nchannels = m_asbd.mChannelsPerFrame;
+    const int32_t *src[8];
+    for (unsigned n = 0; n < nchannels; ++n)
+        src[n] = &m_planar[n * blocksize];
+    flac::interleave(src, nchannels, 32 - m_asbd.mBitsPerChannel,
+                     blocksize, dst);
+}
+
+void NativeFLACSource::setInputPosition(int64_t offset)
+{
+    if (offset >= m_input_offset &&
+        offset <= m_input_offset + static_cast<int64_t>(m_input_end)) {
+        m_bitpos = static_cast<size_t>(offset - m_input_offset) << 3;
+        return;
+    }
+    CHECKCRT(_lseeki64(fd(), offset, SEEK_SET) < 0);
+    m_input_offset = offset;
+    m_input_end = m_bitpos = m_bitlimit = 0;
+    m_input_eof = false;
+}
+
+/* make sure nbytes from the current position are in the buffer */
+void NativeFLACSource::fill(size_t nbytes)
+{
+    size_t pos = m_bitpos >> 3;
+    if (m_input_end - pos >= nbytes || m_input_eof)
+        return;
+    size_t keep = m_input_end - pos;
+    if (keep && pos)
+        std::memmove(&m_input[0], &m_input[pos], keep);
+    m_input_offset += pos;
+    m_input_end = keep;
+    m_bitpos &= 7;
+
+    size_t size = std::max(nbytes, nflac::INPUT_BUFFER_SIZE);
+    if (m_input.size() < size + 8)
+        m_input.resize(size + 8);
+    while (m_input_end < nbytes) {
+        ssize_t n = util::nread(fd(), &m_input[m_input_end],
+                                m_input.size() - 8 - m_input_end);
+        if (n <= 0) {
+            m_input_eof = true;
+            break;
+        }
+        m_input_end += n;
+    }
+    std::memset(&m_input[m_input_end], 0, 8);
+    m_bitlimit = m_input_end << 3;
+}
+
+unsigned NativeFLACSource::unary()
+{
+    unsigned q = 0;
+    uint64_t v;
+    while (!(v = peek())) {
+        q += 56;
+        m_bitpos += 56;
+    }
+    unsigned n = nflac::clz64(v);
+    m_bitpos += n + 1;
+    return q + n;
+}
@@ -0,0 +1,116 @@
+#ifndef _NFLACSRC_H
+#define _NFLACSRC_H
+
+#include "iointer.h"
+
+/*
+ * FLAC decoder not depending on libFLAC, used when libFLAC is not
+ * available. Native FLAC stream only; Ogg FLAC is not supported.
+ */
+class NativeFLACSource: public ISeekableSource, public ITagParser
+{
+    struct SeekPoint {
+        uint64_t sample;
+        uint64_t offset;
+    };
+    struct FrameHeader {
+        uint64_t sample;
+        unsigned blocksize;
+        unsigned assignment;
+        unsigned size;
+    };
+    struct BufferUnderrun {};
+
+    uint32_t m_min_blocksize;
+    uint32_t m_max_blocksize;
+    uint32_t m_max_framesize;
+    uint64_t m_length;
+    int64_t m_position;
+    uint64_t m_next_sample;
+    int64_t m_first_frame;
+    int64_t m_file_length;
+    std::shared_ptr<FILE> m_fp;
+    std::vector<SeekPoint> m_seektable;
+    std::vector<uint32_t> m_chanmap;
+    std::map<uint32_t, std::wstring> m_tags;
+    std::vector<chapters::entry_t> m_chapters;
+    std::vector<int32_t> m_planar;
+    DecodeBuffer<int32_t> m_buffer;
+    AudioStreamBasicDescription m_asbd;
+
+    /* input buffer, with 8 bytes of zero padding after m_input_end */
+    std::vector<uint8_t> m_input;
+    int64_t m_input_offset;
+    size_t m_input_end;
+    size_t m_bitpos;
+    size_t m_bitlimit;
+    bool m_input_eof;
+public:
+    explicit NativeFLACSource(const std::shared_ptr<FILE> &fp);
+    uint64_t length() const { return m_length; }
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_asbd;
+    }
+    const std::vector<uint32_t> *getChannels() const
+    {
+        return m_chanmap.size() ? &m_chanmap : 0;
+    }
+    int64_t getPosition() { return m_position; }
+    size_t readSamples(void *buffer, size_t nsamples);
+    bool isSeekable() { return util::is_seekable(fileno(m_fp.get())); }
+    void seekTo(int64_t count);
+    const std::map<uint32_t, std::wstring> &getTags() const { return m_tags; }
+    const std::vector<chapters::entry_t> *getChapters() const
+    {
+        return m_chapters.size() ? &m_chapters : 0;
+    }
+private:
+    int fd() { return fileno(m_fp.get()); }
+    void parseMetadata();
+    void parseStreamInfo(const uint8_t *p, size_t size);
+    void parseSeekTable(const uint8_t *p, size_t size);
+    void parseVorbisComment(const uint8_t *p, size_t size);
+
+    bool decodeFrame(FrameHeader *h);
+    bool parseFrameHeader(size_t pos, FrameHeader *h);
+    bool syncFrame(FrameHeader *h);
+    void decodeSubframe(unsigned bps, unsigned blocksize, int32_t *out);
+    void decodeResidual(unsigned order, unsigned blocksize, int32_t *out);
+    void interleave(unsigned blocksize, int32_t *dst);
+
+    void setInputPosition(int64_t offset);
+    int64_t inputPosition() { return m_input_offset + (m_bitpos >> 3); }
+    void fill(size_t nbytes);
+    uint64_t peek()
+    {
+        if (m_bitpos > m_bitlimit)
+            throw BufferUnderrun();
+        const uint8_t *p = &m_input[m_bitpos >> 3];
+        uint64_t v = (static_cast<uint64_t>(p[0]) << 56)
+                   | (static_cast<uint64_t>(p[1]) << 48)
+                   | (static_cast<uint64_t>(p[2]) << 40)
+                   | (static_cast<uint64_t>(p[3]) << 32)
+                   | (static_cast<uint64_t>(p[4]) << 24)
+                   | (static_cast<uint64_t>(p[5]) << 16)
+                   | (static_cast<uint64_t>(p[6]) << 8)
+                   | p[7];
+        return v << (m_bitpos & 7);
+    }
+    uint32_t bits(unsigned n)
+    {
+        if (!n) return 0;
+        uint32_t v = static_cast<uint32_t>(peek() >> (64 - n));
+        m_bitpos += n;
+        return v;
+    }
+    int32_t sbits(unsigned n)
+    {
+        if (!n) return 0;
+        uint32_t v = bits(n) << (32 - n);
+        return static_cast<int32_t>(v) >> (32 - n);
+    }
+    unsigned unary();
+};
+
+#endif
@@ -18,6 +18,7 @@ static wide::option long_options[] = {
 #endif
 #ifdef REFALAC
     { L"fast", no_argument, 0, 'afst' },
+    { L"verify", no_argument, 0, 'vrfy' },
 #endif
     { L"check", no_argument, 0, 'chck' },
     { L"decode", no_argument, 0, 'D' },
@@ -43,7 +44,10 @@ static wide::option long_options[] = {
     { L"silent", no_argument, 0, 's' },
     { L"verbose", no_argument, 0, 'verb' },
     { L"stat", no_argument, 0, 'S' },
+    { L"profile", no_argument, 0, 'prof' },
     { L"threading", no_argument, 0, 'thrd' },
+    { L"block-size", required_argument, 0, 'blks' },
+    { L"max-open-files", required_argument, 0, 'mxof' },
     { L"nice", no_argument, 0, 'n' },
     { L"sort-args", no_argument, 0, 'soar' },
     { L"tmpdir", required_argument, 0, 'tmpd' },
@@ -58,6 +62,14 @@ static wide::option long_options[] = {
     { L"fname-from-tag", no_argument, 0, 'fftg' },
     { L"fname-format", required_argument, 0, 'nfmt' },
     { L"log", required_argument, 0, 'log ' },
+    { L"log-prefix", required_argument, 0, 'logp' },
+    { L"progress-json", required_argument, 0, 'pjsn' },
+    { L"progress-interval", required_argument, 0, 'pint' },
+    { L"signal", required_argument, 0, 'sgnl' },
+    { L"min-speed", required_argument, 0, 'mspd' },
+#ifdef QAAC_COUNTERS
+    { L"trace", required_argument, 0, 'trce' },
+#endif
     { L"title", required_argument, 0, Tag::kTitle },
     { L"subtitle", required_argument, 0, Tag::kSubTitle },
     { L"artist", required_argument, 0, Tag::kArtist },
@@ -135,6 +147,9 @@ void usage()
 #endif
 #ifdef REFALAC
 "--fast                 Fast stereo encoding mode.\n"
+"--verify               Decode each packet after encoding and check that\n"
+"                       it matches the input. Also shows a digest of the\n"
+"                       encoded packets.\n"
 #endif
 "-d <dirname>           Output directory. Default is current working dir.\n"
 "--check                Show library versions and exit.\n"
@@ -206,6 +221,14 @@ void usage()
 "--verbose              More verbose console messages.\n"
 "-i, --ignorelength     Assume WAV input and ignore the data chunk length.\n"
 "--threading            Enable multi-threading.\n"
+"--block-size <n>       Number of sample frames read at once through the\n"
+"                       filter chain (256-1048576). Rounded up to a\n"
+"                       multiple of the encoder frame length.\n"
+"                       Default is 4096.\n"
+"--max-open-files <n>   Maximum number of input decoders kept open at a\n"
+"                       time. With --threading, a file decoded in\n"
+"                       parallel counts each of its decoders. Others are\n"
+"                       reopened when needed. Default is 16.\n"
 "-n, --nice             Give lower process priority.\n"
 "--sort-args            Sort filenames given by command line arguments.\n"
 "--text-codepage <n>    Specify text code page of cuesheet/chapter/lyrics.\n"
@@ -213,7 +236,25 @@ void usage()
 "                       Use this when bogus values are written into tags"
 "                       due to automatic encoding detection failure.\n"
 "-S, --stat             Save bitrate statistics into file.\n"
+"--profile              Show time spent in each stage of the pipeline\n"
+"                       after each file (also as JSON with --log).\n"
 "--log <filename>       Output message to file.\n"
+"--log-prefix <text>    Prepend text to each line written to the log file.\n"
+"                       ${job} in text is replaced with the name of the\n"
+"                       output file being processed. With this option,\n"
+"                       the log file is appended to and can be shared\n"
+"                       by several runs at the same time.\n"
+#ifdef QAAC_COUNTERS
+"--trace <filename>     Record trace spans of the encoding pipeline into\n"
+"                       file (Chrome trace event format).\n"
+#endif
+"--progress-json <target>\n"
+"                       Write progress events as JSON lines to target.\n"
+"                       target is a file descriptor number, a named pipe\n"
+"                       (\\\\.\\pipe\\name) or a filename.\n"
+"--progress-interval <ms>\n"
+"                       Interval of --progress-json progress events.\n"
+"                       Default is 1000.\n"
 "\n"
 "Option for output filename generation:\n"
 "--fname-from-tag       Generate filename based on metadata of input.\n"
@@ -252,6 +293,16 @@ void usage()
 "                       Last part can be omitted, L is assumed by default.\n"
 "                       Cases are ignored. u16b is OK.\n"
 "\n"
+"Options for benchmarking:\n"
+"--signal <type[:seconds]>\n"
+"                       Encode a generated test signal instead of input\n"
+"                       files. type is one of silence, sine, noise, pink\n"
+"                       and music. Length defaults to 60 seconds.\n"
+"                       Sample format is taken from --raw-channels,\n"
+"                       --raw-rate and --raw-format.\n"
+"--min-speed <x>        Exit with status 3 when encoding speed of any file\n"
+"                       is slower than x times realtime.\n"
+"\n"
 #ifdef QAAC
 "Options for CoreAudio sample rate converter:\n"
 "--native-resampler[=line|norm|bats,n]\n"
@@ -395,6 +446,30 @@ bool Options::parse(int &argc, wchar_t **&argv)
         }
         else if (ch == 'log ')
             this->logfilename = wide::optarg;
+        else if (ch == 'logp')
+            this->log_prefix = wide::optarg;
+#ifdef QAAC_COUNTERS
+        else if (ch == 'trce')
+            this->trace_file = wide::optarg;
+#endif
+        else if (ch == 'sgnl')
+            this->signal = wide::optarg;
+        else if (ch == 'mspd') {
+            if (std::swscanf(wide::optarg, L"%lf", &this->min_speed) != 1) {
+                std::fputws(L"Invalid arg for --min-speed.\n", stderr);
+                return false;
+            }
+        }
+        else if (ch == 'pjsn')
+            this->progress_json = wide::optarg;
+        else if (ch == 'pint') {
+            if (std::swscanf(wide::optarg, L"%u",
+                             &this->progress_interval) != 1) {
+                std::fputws(L"--progress-interval requires milliseconds.\n",
+                            stderr);
+                return false;
+            }
+        }
         else if (ch == 'nsrc') {
             this->native_resampler = true;
             if (wide::optarg) {
@@ -423,10 +498,27 @@ bool Options::parse(int &argc, wchar_t **&argv)
             this->verbose = 2;
         else if (ch == 'S')
             this->save_stat = true;
+        else if (ch == 'prof')
+            this->profile = true;
         else if (ch == 'n')
             this->nice = true;
         else if (ch == 'thrd')
             this->threading = true;
+        else if (ch == 'mxof') {
+            if (std::swscanf(wide::optarg, L"%u",
+                             &this->max_open_files) != 1
+                || this->max_open_files == 0) {
+                std::fputws(L"Invalid arg for --max-open-files.\n", stderr);
+                return false;
+            }
+        }
+        else if (ch == 'blks') {
+            if (std::swscanf(wide::optarg, L"%u", &this->block_size) != 1
+                || this->block_size < 256 || this->block_size > 0x100000) {
+                std::fputws(L"Invalid arg for --block-size.\n", stderr);
+                return false;
+            }
+        }
         else if (ch == 'i')
             this->ignore_length = true;
         else if (ch == 'R')
@@ -534,6 +626,8 @@ bool Options::parse(int &argc, wchar_t **&argv)
             this->raw_format = wide::optarg;
         else if (ch == 'afst')
             this->alac_fast = true;
+        else if (ch == 'vrfy')
+            this->verify = true;
         else if (ch == 'gain') {
             if (std::swscanf(wide::optarg, L"%lf", &this->gain) != 1) {
                 std::fputws(L"--gain requires an floating point number.\n",
@@ -673,7 +767,8 @@ bool Options::parse(int &argc, wchar_t **&argv)
     argc -= wide::optind;
     argv += wide::optind;
 
-    if (!argc && !this->check_only && !this->print_available_formats) {
+    if (!argc && !this->check_only && !this->print_available_formats &&
+        !this->signal) {
         if (wide::optind == 1)
             return usage(), false;
         else {
@@ -31,12 +31,14 @@ struct Options {
 
         bits_per_sample(0), raw_channels(2), raw_sample_rate(44100),
         artwork_size(0), native_resampler_complexity(0), textcp(0),
-        gapless_mode(0),
+        gapless_mode(0), progress_interval(1000), block_size(0),
+        max_open_files(16),
 
         ofilename(0), outdir(0), raw_format(L"S16LE"),
         fname_format(L"${tracknumber}${title& }${title}"),
         chapter_file(0), logfilename(0), remix_preset(0), remix_file(0),
-        tmpdir(0), delay(0),
+        tmpdir(0), delay(0), progress_json(0), signal(0), log_prefix(0),
+        trace_file(0),
 
         is_raw(false), is_adts(false), save_stat(false), nice(false),
         native_chanmapper(false), ignore_length(false), no_optimize(false),
@@ -44,8 +46,9 @@ struct Options {
         print_available_formats(false), alac_fast(false), threading(false),
         concat(false), no_matrix_normalize(false), no_dither(false),
         filename_from_tag(false), no_delay(false), sort_args(false),
+        profile(false), verify(false),
 
-        gain(0.0),
+        gain(0.0), min_speed(0.0),
 
         output_format(0)
     {}
@@ -95,15 +98,17 @@ struct Options {
                      others: use the value as chanmask     */
     uint32_t bits_per_sample, raw_channels, raw_sample_rate,
              artwork_size, native_resampler_complexity, textcp,
-             gapless_mode;
+             gapless_mode, progress_interval, block_size,
+             max_open_files;
     wchar_t *ofilename, *outdir, *raw_format, *fname_format, *chapter_file,
-            *logfilename, *remix_preset, *remix_file, *tmpdir, *delay;
+            *logfilename, *remix_preset, *remix_file, *tmpdir, *delay,
+            *progress_json, *signal, *log_prefix, *trace_file;
     bool is_raw, is_adts, save_stat, nice, native_chanmapper,
          ignore_length, no_optimize, native_resampler, check_only,
          normalize, print_available_formats, alac_fast, threading,
          concat, no_matrix_normalize, no_dither, filename_from_tag,
-         no_delay, sort_args;
-    double gain;
+         no_delay, sort_args, profile, verify;
+    double gain, min_speed;
 
     uint32_t output_format;
     std::vector<DRCParams> drc_params;
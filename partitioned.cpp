@@ -0,0 +1,192 @@
+#include "partitioned.h"
+#include "inputfactory.h"
+
+PartitionedSource::PartitionedSource(
+        const std::wstring &path,
+        const std::shared_ptr<ISeekableSource> &src, unsigned nworkers,
+        size_t block_samples)
+    : m_path(path), m_src(src), m_released(0), m_stop(false), m_eof(false)
+{
+    m_parser = dynamic_cast<ITagParser*>(src.get());
+    m_base = m_position = src->getPosition();
+    size_t max_samples = MAX_CHUNK_BYTES / getSampleFormat().mBytesPerFrame;
+    m_chunk_samples = std::min(block_samples * BLOCKS_PER_CHUNK,
+                               std::max(max_samples, block_samples));
+    m_ready = win32::create_event();
+    m_workers.resize(nworkers);
+    for (unsigned i = 0; i < nworkers; ++i) {
+        m_workers[i].self = this;
+        m_workers[i].id = i;
+        m_workers[i].wakeup = win32::create_event();
+    }
+    m_chunks.resize(nworkers * 2);
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+        m_chunks[i].index = -1;
+        m_chunks[i].nsamples = 0;
+        m_chunks[i].ready = false;
+    }
+}
+
+size_t PartitionedSource::readSamples(void *buffer, size_t nsamples)
+{
+    if (m_eof)
+        return 0;
+    uint32_t bpf = getSampleFormat().mBytesPerFrame;
+    int64_t chunk_samples = m_chunk_samples;
+    int64_t offset = m_position - m_base;
+    int64_t index = offset / chunk_samples;
+    size_t pos = static_cast<size_t>(offset % chunk_samples);
+    Chunk *chunk = waitChunk(index);
+    if (pos >= chunk->nsamples) {
+        /* workers have finished or are waiting for slots; let them go */
+        m_eof = true;
+        stop();
+        return 0;
+    }
+    size_t n = std::min(nsamples, chunk->nsamples - pos);
+    std::memcpy(buffer, &chunk->data[pos * bpf], n * bpf);
+    m_position += n;
+    if (pos + n == m_chunk_samples) {
+        /* slot is free; it's for the same worker's next chunk */
+        {
+            win32::Lock lock(m_mutex);
+            chunk->ready = false;
+            m_released = index + 1;
+        }
+        SetEvent(m_workers[index % m_workers.size()].wakeup.get());
+    }
+    return n;
+}
+
+void PartitionedSource::seekTo(int64_t count)
+{
+    if (count == m_position)
+        return;
+    stop();
+    m_base = m_position = count;
+    m_released = 0;
+    m_eof = false;
+}
+
+void PartitionedSource::start()
+{
+    if (m_workers[0].thread.get())
+        return;
+    m_stop = false;
+    m_workers[0].src = m_src;
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        intptr_t h = _beginthreadex(0, 0, staticWorkerThreadProc,
+                                    &m_workers[i], 0, 0);
+        if (h == -1) {
+            stop();
+            throw std::runtime_error(std::strerror(errno));
+        }
+        m_workers[i].thread.reset(reinterpret_cast<HANDLE>(h), CloseHandle);
+    }
+}
+
+void PartitionedSource::stop()
+{
+    if (!m_workers[0].thread.get())
+        return;
+    {
+        win32::Lock lock(m_mutex);
+        m_stop = true;
+    }
+    for (size_t i = 0; i < m_workers.size(); ++i)
+        SetEvent(m_workers[i].wakeup.get());
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        if (m_workers[i].thread.get()) {
+            WaitForSingleObject(m_workers[i].thread.get(), INFINITE);
+            m_workers[i].thread.reset();
+        }
+        m_workers[i].src.reset();
+    }
+    releaseChunks();
+}
+
+void PartitionedSource::releaseChunks()
+{
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+        std::vector<uint8_t>().swap(m_chunks[i].data);
+        m_chunks[i].ready = false;
+    }
+}
+
+PartitionedSource::Chunk *PartitionedSource::waitChunk(int64_t index)
+{
+    start();
+    Chunk *chunk = &m_chunks[index % m_chunks.size()];
+    for (;;) {
+        {
+            win32::Lock lock(m_mutex);
+            if (chunk->ready && chunk->index == index) {
+                if (!chunk->error.empty())
+                    throw std::runtime_error(chunk->error);
+                return chunk;
+            }
+        }
+        WaitForSingleObject(m_ready.get(), INFINITE);
+    }
+}
+
+void PartitionedSource::workerThreadProc(Worker *worker)
+{
+    int64_t nslots = m_chunks.size();
+    uint32_t bpf = getSampleFormat().mBytesPerFrame;
+    uint64_t length = m_src->length();
+
+    for (int64_t index = worker->id; ; index += m_workers.size()) {
+        Chunk *chunk = &m_chunks[index % nslots];
+        for (;;) {
+            {
+                win32::Lock lock(m_mutex);
+                if (m_stop)
+                    return;
+                if (index < m_released + nslots)
+                    break;
+            }
+            WaitForSingleObject(worker->wakeup.get(), INFINITE);
+        }
+        /* the slot is not ready, consumer doesn't touch it */
+        size_t nsamples = 0;
+        std::string error;
+        try {
+            int64_t start =
+                m_base + index * static_cast<int64_t>(m_chunk_samples);
+            if (length == ~0ULL || start < static_cast<int64_t>(length)) {
+                if (!worker->src.get())
+                    worker->src =
+                        input::factory()->openSingleDecoder(m_path.c_str());
+                ISeekableSource *src = worker->src.get();
+                if (src->getPosition() != start)
+                    src->seekTo(start);
+                chunk->data.resize(m_chunk_samples * bpf);
+                while (nsamples < m_chunk_samples) {
+                    size_t n = src->readSamples(&chunk->data[nsamples * bpf],
+                                                m_chunk_samples - nsamples);
+                    if (!n)
+                        break;
+                    nsamples += n;
+                }
+            }
+        } catch (const std::exception &e) {
+            error = e.what();
+        } catch (...) {
+            error = "PartitionedSource: unknown error";
+        }
+        {
+            win32::Lock lock(m_mutex);
+            chunk->index = index;
+            chunk->nsamples = nsamples;
+            chunk->error = error;
+            chunk->ready = true;
+        }
+        SetEvent(m_ready.get());
+        if (nsamples < m_chunk_samples) {
+            /* last chunk of this worker; the decoder is not needed */
+            worker->src.reset();
+            return;
+        }
+    }
+}
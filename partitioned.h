@@ -0,0 +1,94 @@
+#ifndef PARTITIONED_H
+#define PARTITIONED_H
+
+#include <process.h>
+#include "iointer.h"
+#include "win32util.h"
+
+/*
+ * Decodes a file with several decoder instances in parallel.
+ * The stream is split into chunks of BLOCKS_PER_CHUNK blocks (bounded to
+ * MAX_CHUNK_BYTES); worker k decodes chunks k, k + N, k + 2N ... by
+ * seeking its own decoder instance, and the consumer reassembles them
+ * in order from a ring of 2N slots.
+ * Worker decoders and slots are released once the end is reached.
+ * Meant for formats with cheap, sample accurate seeking (WavPack, TAK,
+ * native FLAC).
+ */
+class PartitionedSource: public ISeekableSource, public ITagParser {
+    struct Chunk {
+        std::vector<uint8_t> data;
+        int64_t index;
+        size_t nsamples;
+        bool ready;
+        std::string error;
+    };
+    struct Worker {
+        PartitionedSource *self;
+        unsigned id;
+        std::shared_ptr<ISeekableSource> src;
+        std::shared_ptr<void> wakeup, thread;
+    };
+    std::wstring m_path;
+    std::shared_ptr<ISeekableSource> m_src;
+    ITagParser *m_parser;
+    std::map<uint32_t, std::wstring> m_tags;
+    int64_t m_base;     /* start position of chunk 0 */
+    int64_t m_position;
+    int64_t m_released; /* number of chunks consumed */
+    size_t m_chunk_samples;
+    bool m_stop;
+    bool m_eof;         /* consumer has reached the end */
+    std::vector<Chunk> m_chunks;
+    std::vector<Worker> m_workers;
+    win32::CriticalSection m_mutex;
+    std::shared_ptr<void> m_ready;
+public:
+    enum { BLOCKS_PER_CHUNK = 16, MAX_CHUNK_BYTES = 0x100000 };
+
+    /*
+     * src: decoder already opened for path, used by the first worker
+     * block_samples: block size of the filter chain
+     */
+    PartitionedSource(const std::wstring &path,
+                      const std::shared_ptr<ISeekableSource> &src,
+                      unsigned nworkers, size_t block_samples);
+    ~PartitionedSource() { stop(); }
+    uint64_t length() const { return m_src->length(); }
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_src->getSampleFormat();
+    }
+    const std::vector<uint32_t> *getChannels() const
+    {
+        return m_src->getChannels();
+    }
+    int64_t getPosition() { return m_position; }
+    size_t readSamples(void *buffer, size_t nsamples);
+    bool isSeekable() { return true; }
+    void seekTo(int64_t count);
+    /* number of decoder instances open while decoding */
+    size_t numDecoders() const { return m_workers.size(); }
+    const std::map<uint32_t, std::wstring> &getTags() const
+    {
+        return m_parser ? m_parser->getTags() : m_tags;
+    }
+    const std::vector<chapters::entry_t> *getChapters() const
+    {
+        return m_parser ? m_parser->getChapters() : 0;
+    }
+private:
+    void start();
+    void stop();
+    void releaseChunks();
+    Chunk *waitChunk(int64_t index);
+    void workerThreadProc(Worker *worker);
+    static unsigned __stdcall staticWorkerThreadProc(void *arg)
+    {
+        Worker *worker = static_cast<Worker*>(arg);
+        worker->self->workerThreadProc(worker);
+        return 0;
+    }
+};
+
+#endif
@@ -1,19 +1,22 @@
 #include "pipedreader.h"
 
 namespace {
-    const int NSAMPLES = 0x1000;
     const int PIPE_BUF_FACTOR = 4;
+    const size_t MAX_PIPE_BUF = 0x100000;
 }
 
-PipedReader::PipedReader(std::shared_ptr<ISource> &src):
-    FilterBase(src), m_thread(0), m_position(0)
+PipedReader::PipedReader(std::shared_ptr<ISource> &src, size_t block_samples):
+    FilterBase(src), m_thread(0), m_position(0),
+    m_block_samples(block_samples)
 {
     HANDLE hr, hw;
     int fd;
     FILE *fp;
 
     uint32_t bpf = src->getSampleFormat().mBytesPerFrame;
-    if (!CreatePipe(&hr, &hw, 0, NSAMPLES * bpf * PIPE_BUF_FACTOR))
+    size_t bufsize = std::min(m_block_samples * bpf * PIPE_BUF_FACTOR,
+                              MAX_PIPE_BUF);
+    if (!CreatePipe(&hr, &hw, 0, static_cast<DWORD>(bufsize)))
         win32::throw_error("CreatePipe", GetLastError());
     CHECKCRT((fd = _open_osfhandle(reinterpret_cast<intptr_t>(hr),
                                    _O_RDONLY|_O_BINARY)) < 0);
@@ -36,6 +39,8 @@ PipedReader::~PipedReader()
 
 size_t PipedReader::readSamples(void *buffer, size_t nsamples)
 {
+    if (!m_thread.get())
+        start();
     uint32_t bpf = source()->getSampleFormat().mBytesPerFrame;
     ssize_t nread = 0;
     if (m_readPipe.get()) {
@@ -53,12 +58,12 @@ void PipedReader::inputThreadProc()
     try {
         ISource *src = source();
         uint32_t bpf = src->getSampleFormat().mBytesPerFrame;
-        std::vector<uint8_t> buffer(NSAMPLES * bpf);
+        std::vector<uint8_t> buffer(m_block_samples * bpf);
         uint8_t *bp = &buffer[0];
         HANDLE ph = m_writePipe.get();
         size_t n;
         DWORD nb;
-        while ((n = src->readSamples(bp, NSAMPLES)) > 0
+        while ((n = src->readSamples(bp, m_block_samples)) > 0
                && WriteFile(ph, bp, n * bpf, &nb, 0))
             ;
     } catch (...) {}
@@ -9,8 +9,9 @@ class PipedReader: public FilterBase {
     std::shared_ptr<FILE> m_readPipe;
     std::shared_ptr<void> m_writePipe, m_thread;
     int64_t m_position;
+    size_t m_block_samples;
 public:
-    PipedReader(std::shared_ptr<ISource> &src);
+    PipedReader(std::shared_ptr<ISource> &src, size_t block_samples=0x1000);
     ~PipedReader();
     size_t readSamples(void *buffer, size_t nsamples);
     void start()
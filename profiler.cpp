@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <typeinfo>
+#include "profiler.h"
+#include "logging.h"
+#include "strutil.h"
+
+namespace {
+    std::string stage_name(ISource *src)
+    {
+        std::string name = typeid(*src).name();
+        if (name.find("class ") == 0)
+            name = name.substr(6);
+        else if (name.find("struct ") == 0)
+            name = name.substr(7);
+        return name;
+    }
+
+    double filetime_to_seconds(const FILETIME &ft)
+    {
+        uint64_t t = (static_cast<uint64_t>(ft.dwHighDateTime) << 32)
+                   | ft.dwLowDateTime;
+        return t / 10000000.0;
+    }
+
+    /* self time: subtract upstream only when it ran on the same thread */
+    double self_time(double total, const profiler::Stats *upstream,
+                     DWORD thread, bool cpu)
+    {
+        if (upstream && upstream->calls && upstream->thread == thread)
+            total -= cpu ? upstream->cpu : upstream->wall;
+        return std::max(total, 0.0);
+    }
+}
+
+namespace profiler {
+    double wallclock()
+    {
+        static LARGE_INTEGER freq;
+        if (!freq.QuadPart)
+            QueryPerformanceFrequency(&freq);
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return static_cast<double>(now.QuadPart) / freq.QuadPart;
+    }
+
+    double cputime()
+    {
+        FILETIME creation, exit, kernel, user;
+        if (!GetThreadTimes(GetCurrentThread(), &creation, &exit,
+                            &kernel, &user))
+            return 0.0;
+        return filetime_to_seconds(kernel) + filetime_to_seconds(user);
+    }
+}
+
+void Profiler::instrument(std::vector<std::shared_ptr<ISource> > &chain)
+{
+    for (size_t i = 0; i < chain.size(); ++i) {
+        std::shared_ptr<ProfiledSource>
+            stage(new ProfiledSource(chain[i], stage_name(chain[i].get())));
+        m_stages.push_back(stage);
+        if (i + 1 == chain.size())
+            break;
+        FilterBase *next = dynamic_cast<FilterBase*>(chain[i + 1].get());
+        /*
+         * Filters that handed their source to somebody else at
+         * construction (CoreAudioResampler) are left as is; their upstream
+         * is then folded into them.
+         */
+        if (next && next->sourcePtr() == chain[i])
+            next->setSource(stage);
+    }
+    if (m_stages.size())
+        chain.back() = m_stages.back();
+}
+
+std::shared_ptr<ISink>
+Profiler::instrument(const std::shared_ptr<ISink> &sink)
+{
+    m_sink = std::make_shared<ProfiledSink>(sink);
+    return m_sink;
+}
+
+void Profiler::report(const std::wstring &filename) const
+{
+    std::vector<const profiler::Stats *> rows;
+    std::vector<double> self_wall, self_cpu;
+    std::vector<uint64_t> samples_in;
+
+    for (size_t i = 0; i < m_stages.size(); ++i) {
+        const profiler::Stats &s = m_stages[i]->stats();
+        const profiler::Stats *up = i ? &m_stages[i - 1]->stats() : 0;
+        rows.push_back(&s);
+        self_wall.push_back(self_time(s.wall, up, s.thread, false));
+        self_cpu.push_back(self_time(s.cpu, up, s.thread, true));
+        samples_in.push_back(up ? up->samples : s.samples);
+    }
+    const profiler::Stats *tail =
+        m_stages.size() ? &m_stages.back()->stats() : 0;
+    const profiler::Stats *sink = m_sink.get() ? &m_sink->stats() : 0;
+    if (m_encoder.calls) {
+        double wall = self_time(m_encoder.wall, tail, m_encoder.thread, false);
+        double cpu = self_time(m_encoder.cpu, tail, m_encoder.thread, true);
+        if (sink && sink->thread == m_encoder.thread) {
+            wall = std::max(wall - sink->wall, 0.0);
+            cpu = std::max(cpu - sink->cpu, 0.0);
+        }
+        rows.push_back(&m_encoder);
+        self_wall.push_back(wall);
+        self_cpu.push_back(cpu);
+        samples_in.push_back(tail ? tail->samples : 0);
+    }
+    if (sink) {
+        rows.push_back(sink);
+        self_wall.push_back(sink->wall);
+        self_cpu.push_back(sink->cpu);
+        samples_in.push_back(sink->samples);
+    }
+
+    LOG(L"%-20hs %8hs %12hs %12hs %8hs %9hs %9hs %9hs\n",
+        "Stage", "Calls", "In", "Out", "Block", "Wall", "CPU", "Total");
+    std::wstring json =
+        strutil::format(L"{\"file\":\"%s\",\"stages\":[",
+                        strutil::json_escape(filename).c_str());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const profiler::Stats &s = *rows[i];
+        double block = s.calls ? static_cast<double>(s.samples) / s.calls : 0;
+        LOG(L"%-20hs %8llu %12llu %12llu %8.0f %9.3f %9.3f %9.3f\n",
+            s.name.c_str(), s.calls, samples_in[i], s.samples, block,
+            self_wall[i], self_cpu[i], s.wall);
+        json += strutil::format(
+            L"%s{\"name\":\"%hs\",\"calls\":%llu,\"samples_in\":%llu,"
+            L"\"samples_out\":%llu,\"avg_block\":%.1f,\"wall\":%.6f,"
+            L"\"cpu\":%.6f,\"total_wall\":%.6f,\"total_cpu\":%.6f}",
+            i ? L"," : L"", s.name.c_str(), s.calls, samples_in[i],
+            s.samples, block, self_wall[i], self_cpu[i], s.wall, s.cpu);
+    }
+    json += L"]}\n";
+    Log::instance()->write_files(json);
+}
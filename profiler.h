@@ -0,0 +1,99 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include "iointer.h"
+#include "win32util.h"
+
+/*
+ * Per-stage pipeline instrumentation for --profile.
+ * Times are inclusive (a filter's time contains that of its upstream);
+ * the report derives self time by subtracting the upstream stage, when
+ * both run on the same thread.
+ */
+namespace profiler {
+    struct Stats {
+        std::string name;
+        uint64_t calls;
+        uint64_t samples;
+        double wall;
+        double cpu;
+        DWORD thread; /* thread of the last call */
+
+        explicit Stats(const std::string &name)
+            : name(name), calls(0), samples(0), wall(0.0), cpu(0.0),
+              thread(0)
+        {}
+    };
+
+    double wallclock();
+    double cputime();
+
+    class Scope {
+        Stats *m_stats;
+        double m_wall, m_cpu;
+    public:
+        explicit Scope(Stats *stats)
+            : m_stats(stats), m_wall(wallclock()), m_cpu(cputime())
+        {}
+        ~Scope()
+        {
+            m_stats->wall += wallclock() - m_wall;
+            m_stats->cpu += cputime() - m_cpu;
+            m_stats->thread = GetCurrentThreadId();
+            ++m_stats->calls;
+        }
+    };
+}
+
+class ProfiledSource: public FilterBase {
+    profiler::Stats m_stats;
+public:
+    ProfiledSource(const std::shared_ptr<ISource> &src,
+                   const std::string &name)
+        : FilterBase(src), m_stats(name)
+    {}
+    size_t readSamples(void *buffer, size_t nsamples)
+    {
+        profiler::Scope scope(&m_stats);
+        size_t n = source()->readSamples(buffer, nsamples);
+        m_stats.samples += n;
+        return n;
+    }
+    const profiler::Stats &stats() const { return m_stats; }
+};
+
+class ProfiledSink: public ISink {
+    std::shared_ptr<ISink> m_sink;
+    profiler::Stats m_stats;
+public:
+    explicit ProfiledSink(const std::shared_ptr<ISink> &sink)
+        : m_sink(sink), m_stats("Sink")
+    {}
+    void writeSamples(const void *data, size_t len, size_t nsamples)
+    {
+        profiler::Scope scope(&m_stats);
+        m_sink->writeSamples(data, len, nsamples);
+        m_stats.samples += nsamples;
+    }
+    const profiler::Stats &stats() const { return m_stats; }
+};
+
+class Profiler {
+    std::vector<std::shared_ptr<ProfiledSource> > m_stages;
+    std::shared_ptr<ProfiledSink> m_sink;
+    profiler::Stats m_encoder;
+public:
+    Profiler(): m_encoder("Encoder") {}
+    /*
+     * Puts a ProfiledSource after every stage of the chain, and replaces
+     * chain.back() with the last one. Must be called before anything is
+     * read from the chain.
+     */
+    void instrument(std::vector<std::shared_ptr<ISource> > &chain);
+    std::shared_ptr<ISink> instrument(const std::shared_ptr<ISink> &sink);
+    profiler::Stats *encoder() { return &m_encoder; }
+    /* table to LOG(), and a JSON line to the log file if any */
+    void report(const std::wstring &filename) const;
+};
+
+#endif
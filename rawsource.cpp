@@ -2,6 +2,70 @@
 #include "win32util.h"
 #include "cautil.h"
 
+namespace {
+    /*
+     * One kernel per (type, width, endianness). Each converts W byte
+     * input samples to the output format (left justified int32, or
+     * native endian float) in a single pass.
+     */
+    template <unsigned W, bool BE, bool U>
+    void decodeInt(const uint8_t *src, void *dst, size_t count)
+    {
+        uint32_t *dp = static_cast<uint32_t*>(dst);
+        for (size_t i = 0; i < count; ++i, src += W) {
+            uint32_t v = 0;
+            for (unsigned k = 0; k < W; ++k)
+                v |= static_cast<uint32_t>(src[BE ? k : W - 1 - k])
+                        << (24 - 8 * k);
+            dp[i] = U ? v ^ 0x80000000U : v;
+        }
+    }
+
+    void decodeFloat32BE(const uint8_t *src, void *dst, size_t count)
+    {
+        uint32_t *dp = static_cast<uint32_t*>(dst);
+        for (size_t i = 0; i < count; ++i, src += 4) {
+            uint32_t v;
+            std::memcpy(&v, src, 4);
+            dp[i] = util::b2host32(v);
+        }
+    }
+
+    void decodeFloat64BE(const uint8_t *src, void *dst, size_t count)
+    {
+        uint64_t *dp = static_cast<uint64_t*>(dst);
+        for (size_t i = 0; i < count; ++i, src += 8) {
+            uint64_t v;
+            std::memcpy(&v, src, 8);
+            dp[i] = util::b2host64(v);
+        }
+    }
+
+    /* [unsigned][big endian][width - 1] */
+    void (* const int_kernels[2][2][4])(const uint8_t *, void *, size_t) = {
+        {
+            {
+                decodeInt<1, false, false>, decodeInt<2, false, false>,
+                decodeInt<3, false, false>, 0
+            },
+            {
+                decodeInt<1, true, false>, decodeInt<2, true, false>,
+                decodeInt<3, true, false>, decodeInt<4, true, false>
+            }
+        },
+        {
+            {
+                decodeInt<1, false, true>, decodeInt<2, false, true>,
+                decodeInt<3, false, true>, decodeInt<4, false, true>
+            },
+            {
+                decodeInt<1, true, true>, decodeInt<2, true, true>,
+                decodeInt<3, true, true>, decodeInt<4, true, true>
+            }
+        }
+    };
+}
+
 RawSource::RawSource(const std::shared_ptr<FILE> &fp,
                      const AudioStreamBasicDescription &asbd)
     : m_position(0), m_fp(fp), m_asbd(asbd)
@@ -18,34 +82,35 @@ RawSource::RawSource(const std::shared_ptr<FILE> &fp,
                                        isfloat ? asbd.mBitsPerChannel : 32,
                                        isfloat ? kAudioFormatFlagIsFloat
                                           : kAudioFormatFlagIsSignedInteger);
+    unsigned width = asbd.mBytesPerFrame / asbd.mChannelsPerFrame;
+    bool big_endian = asbd.mFormatFlags & kAudioFormatFlagIsBigEndian;
+    if (isfloat) {
+        if (!big_endian)
+            m_decode = 0;
+        else
+            m_decode = width == 4 ? decodeFloat32BE : decodeFloat64BE;
+    } else {
+        bool is_unsigned =
+            !(asbd.mFormatFlags & kAudioFormatFlagIsSignedInteger);
+        m_decode = int_kernels[is_unsigned][big_endian][width - 1];
+    }
 }
 
 size_t RawSource::readSamples(void *buffer, size_t nsamples)
 {
-    ssize_t nbytes = nsamples * m_asbd.mBytesPerFrame;
-    if (m_buffer.size() < nbytes)
-        m_buffer.resize(nbytes);
-    nbytes = util::nread(fileno(m_fp.get()), &m_buffer[0], nbytes);
-    nsamples = nbytes > 0 ? nbytes / m_asbd.mBytesPerFrame : 0;
-    if (nsamples) {
-        size_t size = nsamples * m_asbd.mBytesPerFrame;
-
-        /* bswap */
-        if (m_asbd.mFormatFlags & kAudioFormatFlagIsBigEndian)
-            util::bswapbuffer(&m_buffer[0], size,
-                              (m_asbd.mBitsPerChannel + 7) & ~7);
-
-        util::unpack(&m_buffer[0], buffer, &size,
-                     m_asbd.mBytesPerFrame / m_asbd.mChannelsPerFrame,
-                     m_oasbd.mBytesPerFrame / m_oasbd.mChannelsPerFrame);
-        /* convert to signed */
-        if (!(m_asbd.mFormatFlags & kAudioFormatFlagIsFloat) &&
-            !(m_asbd.mFormatFlags & kAudioFormatFlagIsSignedInteger))
-        {
-            util::convert_sign(static_cast<uint32_t *>(buffer),
-                               nsamples * m_asbd.mChannelsPerFrame);
-        }
-    }
+    /*
+     * Read into the tail of the caller's buffer and decode forward in place.
+     * Output samples are never narrower than input ones, so a write never
+     * overtakes input that is yet to be read.
+     */
+    size_t ibpf = m_asbd.mBytesPerFrame;
+    size_t obpf = m_oasbd.mBytesPerFrame;
+    uint8_t *bp = static_cast<uint8_t*>(buffer);
+    uint8_t *ip = bp + nsamples * (obpf - ibpf);
+    ssize_t nbytes = util::nread(fileno(m_fp.get()), ip, nsamples * ibpf);
+    nsamples = nbytes > 0 ? nbytes / ibpf : 0;
+    if (nsamples && m_decode)
+        m_decode(ip, bp, nsamples * m_asbd.mChannelsPerFrame);
     m_position += nsamples;
     return nsamples;
 }
@@ -4,10 +4,12 @@
 #include "iointer.h"
 
 class RawSource: public ISeekableSource {
+    typedef void (*decode_t)(const uint8_t *, void *, size_t);
+
     uint64_t m_length;
     int64_t m_position;
     std::shared_ptr<FILE> m_fp;
-    std::vector<uint8_t> m_buffer;
+    decode_t m_decode; /* 0 if input is already in the output format */
     AudioStreamBasicDescription m_asbd, m_oasbd;
 public:
     RawSource(const std::shared_ptr<FILE> &fp,
@@ -0,0 +1,160 @@
+#include "readahead.h"
+
+ReadAheadSource::ReadAheadSource(const std::shared_ptr<ISeekableSource> &src,
+                                 size_t block_samples)
+    : m_src(src), m_current_offset(0), m_block_samples(block_samples),
+      m_eof(false), m_stop(false)
+{
+    m_parser = dynamic_cast<ITagParser*>(src.get());
+    m_position = src->getPosition();
+    m_current.nsamples = 0;
+    m_filled = win32::create_event();
+    m_drained = win32::create_event();
+}
+
+size_t ReadAheadSource::readSamples(void *buffer, size_t nsamples)
+{
+    if (m_current_offset == m_current.nsamples && !fetchBlock())
+        return 0;
+    uint32_t bpf = getSampleFormat().mBytesPerFrame;
+    size_t n = std::min(nsamples, m_current.nsamples - m_current_offset);
+    std::memcpy(buffer, &m_current.data[m_current_offset * bpf], n * bpf);
+    m_current_offset += n;
+    m_position += n;
+    return n;
+}
+
+void ReadAheadSource::seekTo(int64_t count)
+{
+    /* keep what was already decoded, when we are exactly there */
+    if (count == m_position) {
+        win32::Lock lock(m_mutex);
+        if (m_error.empty())
+            return;
+    }
+    stop();
+    m_src->seekTo(count);
+    m_blocks.clear();
+    m_current.nsamples = m_current_offset = 0;
+    m_eof = false;
+    m_error.clear();
+    m_position = count;
+}
+
+void ReadAheadSource::prime()
+{
+    if (m_thread.get())
+        return;
+    m_stop = false;
+    intptr_t h = _beginthreadex(0, 0, staticReadAheadThreadProc,
+                                this, 0, 0);
+    if (h == -1)
+        throw std::runtime_error(std::strerror(errno));
+    m_thread.reset(reinterpret_cast<HANDLE>(h), CloseHandle);
+}
+
+bool ReadAheadSource::fetchBlock()
+{
+    prime();
+    for (;;) {
+        {
+            win32::Lock lock(m_mutex);
+            if (m_blocks.size()) {
+                m_current.data.swap(m_blocks.front().data);
+                m_current.nsamples = m_blocks.front().nsamples;
+                m_current_offset = 0;
+                if (m_blocks.front().data.size() &&
+                    m_free.size() < MAX_FREE) {
+                    m_free.push_back(std::vector<uint8_t>());
+                    m_free.back().swap(m_blocks.front().data);
+                }
+                m_blocks.pop_front();
+                break;
+            }
+            if (!m_error.empty())
+                throw std::runtime_error(m_error);
+            if (m_eof) {
+                /* finished sources are kept until exit by the playlist */
+                releaseBuffers();
+                return false;
+            }
+        }
+        WaitForSingleObject(m_filled.get(), INFINITE);
+    }
+    SetEvent(m_drained.get());
+    return true;
+}
+
+void ReadAheadSource::stop()
+{
+    if (!m_thread.get())
+        return;
+    {
+        win32::Lock lock(m_mutex);
+        m_stop = true;
+    }
+    SetEvent(m_drained.get());
+    WaitForSingleObject(m_thread.get(), INFINITE);
+    m_thread.reset();
+    releaseBuffers();
+}
+
+void ReadAheadSource::releaseBuffers()
+{
+    std::vector<std::vector<uint8_t> >().swap(m_free);
+    std::vector<uint8_t>().swap(m_current.data);
+    m_current.nsamples = m_current_offset = 0;
+}
+
+void ReadAheadSource::readAheadThreadProc()
+{
+    std::string error;
+    try {
+        uint32_t bpf = m_src->getSampleFormat().mBytesPerFrame;
+        size_t max_blocks = std::max(MAX_BYTES / (m_block_samples * bpf),
+                                     static_cast<size_t>(2));
+        for (;;) {
+            bool full;
+            {
+                win32::Lock lock(m_mutex);
+                if (m_stop)
+                    return;
+                full = m_blocks.size() >= max_blocks;
+            }
+            if (full) {
+                WaitForSingleObject(m_drained.get(), INFINITE);
+                continue;
+            }
+            Block block;
+            {
+                win32::Lock lock(m_mutex);
+                if (m_free.size()) {
+                    block.data.swap(m_free.back());
+                    m_free.pop_back();
+                }
+            }
+            block.data.resize(m_block_samples * bpf);
+            block.nsamples = m_src->readSamples(&block.data[0],
+                                                m_block_samples);
+            if (!block.nsamples)
+                break;
+            {
+                win32::Lock lock(m_mutex);
+                m_blocks.push_back(Block());
+                m_blocks.back().data.swap(block.data);
+                m_blocks.back().nsamples = block.nsamples;
+            }
+            SetEvent(m_filled.get());
+        }
+    } catch (const std::exception &e) {
+        error = e.what();
+    } catch (...) {
+        error = "ReadAheadSource: unknown error";
+    }
+    {
+        win32::Lock lock(m_mutex);
+        m_eof = true;
+        m_error = error;
+    }
+    SetEvent(m_filled.get());
+}
@@ -0,0 +1,80 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <deque>
+#include <process.h>
+#include "iointer.h"
+#include "win32util.h"
+
+/*
+ * Decodes the source ahead of the consumer on a separate thread,
+ * into a bounded queue of blocks.
+ * prime() starts decoding before the first readSamples(), so that
+ * the next file of a playlist can be opened/decoded in background.
+ */
+class ReadAheadSource: public ISeekableSource, public ITagParser {
+    struct Block {
+        std::vector<uint8_t> data;
+        size_t nsamples;
+    };
+    std::shared_ptr<ISeekableSource> m_src;
+    ITagParser *m_parser;
+    std::map<uint32_t, std::wstring> m_tags;
+    int64_t m_position;
+    Block m_current;
+    size_t m_current_offset;
+    std::deque<Block> m_blocks;
+    std::vector<std::vector<uint8_t> > m_free; /* recycled block buffers */
+    size_t m_block_samples;
+    bool m_eof;
+    bool m_stop;
+    std::string m_error;
+    win32::CriticalSection m_mutex;
+    std::shared_ptr<void> m_filled, m_drained, m_thread;
+public:
+    /*
+     * queue is bounded by MAX_BYTES, but holds at least 2 blocks.
+     * at most MAX_FREE drained buffers are kept for reuse.
+     */
+    enum { BLOCK_SAMPLES = 0x1000, MAX_BYTES = 0x400000, MAX_FREE = 2 };
+
+    explicit ReadAheadSource(const std::shared_ptr<ISeekableSource> &src,
+                             size_t block_samples=BLOCK_SAMPLES);
+    ~ReadAheadSource() { stop(); }
+    ISeekableSource *source() { return m_src.get(); }
+    uint64_t length() const { return m_src->length(); }
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_src->getSampleFormat();
+    }
+    const std::vector<uint32_t> *getChannels() const
+    {
+        return m_src->getChannels();
+    }
+    int64_t getPosition() { return m_position; }
+    size_t readSamples(void *buffer, size_t nsamples);
+    bool isSeekable() { return m_src->isSeekable(); }
+    void seekTo(int64_t count);
+    void prime();
+    const std::map<uint32_t, std::wstring> &getTags() const
+    {
+        return m_parser ? m_parser->getTags() : m_tags;
+    }
+    const std::vector<chapters::entry_t> *getChapters() const
+    {
+        return m_parser ? m_parser->getChapters() : 0;
+    }
+private:
+    bool fetchBlock();
+    void stop();
+    void releaseBuffers();
+    void readAheadThreadProc();
+    static unsigned __stdcall staticReadAheadThreadProc(void *arg)
+    {
+        ReadAheadSource *self = static_cast<ReadAheadSource*>(arg);
+        self->readAheadThreadProc();
+        return 0;
+    }
+};
+
+#endif
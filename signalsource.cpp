@@ -0,0 +1,146 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "signalsource.h"
+#include "cautil.h"
+
+namespace {
+    const double PI = 3.14159265358979323846;
+
+    template <typename T>
+    void store(const std::vector<double> &v, void *buffer)
+    {
+        T *dst = static_cast<T*>(buffer);
+        for (size_t i = 0; i < v.size(); ++i)
+            dst[i] = static_cast<T>(v[i]);
+    }
+
+    void store_int(const std::vector<double> &v, unsigned bits, void *buffer)
+    {
+        int32_t *dst = static_cast<int32_t*>(buffer);
+        uint32_t mask = ~0U << (32 - bits);
+        for (size_t i = 0; i < v.size(); ++i) {
+            double x = std::floor(v[i] * 2147483648.0 + 0.5);
+            if (x > 2147483647.0) x = 2147483647.0;
+            else if (x < -2147483648.0) x = -2147483648.0;
+            dst[i] = static_cast<int32_t>(static_cast<int64_t>(x) & mask);
+        }
+    }
+}
+
+SignalSource::SignalSource(Type type, const AudioStreamBasicDescription &asbd,
+                           uint64_t length)
+    : m_type(type), m_length(length), m_position(0)
+{
+    bool isfloat = asbd.mFormatFlags & kAudioFormatFlagIsFloat;
+    m_asbd = cautil::buildASBDForPCM2(asbd.mSampleRate,
+                                      asbd.mChannelsPerFrame,
+                                      asbd.mBitsPerChannel,
+                                      isfloat ? asbd.mBitsPerChannel : 32,
+                                      isfloat ? kAudioFormatFlagIsFloat
+                                         : kAudioFormatFlagIsSignedInteger);
+    render();
+}
+
+SignalSource::Type SignalSource::typeFromName(const std::wstring &name)
+{
+    static const wchar_t * const names[] = {
+        L"silence", L"sine", L"noise", L"pink", L"music"
+    };
+    for (size_t i = 0; i < util::sizeof_array(names); ++i)
+        if (name == names[i])
+            return static_cast<Type>(i);
+    throw std::runtime_error("Unknown signal type");
+}
+
+size_t SignalSource::readSamples(void *buffer, size_t nsamples)
+{
+    if (m_position >= static_cast<int64_t>(m_length))
+        return 0;
+    nsamples = std::min(static_cast<uint64_t>(nsamples),
+                        m_length - m_position);
+    uint32_t bpf = m_asbd.mBytesPerFrame;
+    uint8_t *bp = static_cast<uint8_t*>(buffer);
+    for (size_t done = 0; done < nsamples; ) {
+        size_t off = static_cast<size_t>((m_position + done) % m_period);
+        size_t n = std::min(nsamples - done, m_period - off);
+        std::memcpy(bp + done * bpf, &m_table[off * bpf], n * bpf);
+        done += n;
+    }
+    m_position += nsamples;
+    return nsamples;
+}
+
+void SignalSource::render()
+{
+    m_period = static_cast<size_t>(
+        std::min(m_length,
+                 static_cast<uint64_t>(m_asbd.mSampleRate * PERIOD)));
+    uint32_t bpf = m_asbd.mBytesPerFrame;
+    unsigned nchannels = m_asbd.mChannelsPerFrame;
+    m_table.resize(m_period * bpf);
+    m_rng.seed(0);
+    m_pink.assign(7 * nchannels, 0.0);
+
+    const size_t block = 4096;
+    std::vector<double> v;
+    for (size_t pos = 0; pos < m_period; pos += block) {
+        size_t nsamples = std::min(block, m_period - pos);
+        v.resize(nsamples * nchannels);
+        for (size_t i = 0; i < nsamples; ++i)
+            for (unsigned c = 0; c < nchannels; ++c)
+                v[i * nchannels + c] = generate(pos + i, c);
+        void *dst = &m_table[pos * bpf];
+        if (!(m_asbd.mFormatFlags & kAudioFormatFlagIsFloat))
+            store_int(v, m_asbd.mBitsPerChannel, dst);
+        else if (m_asbd.mBitsPerChannel == 32)
+            store<float>(v, dst);
+        else
+            store<double>(v, dst);
+    }
+}
+
+double SignalSource::generate(int64_t n, unsigned channel)
+{
+    double t = n / m_asbd.mSampleRate;
+    switch (m_type) {
+    case kSine:
+        return 0.5 * std::sin(2.0 * PI * 997.0 * t + channel * PI / 4.0);
+    case kNoise:
+        return white() * 0.5;
+    case kPink:
+        return pink(channel) * 0.5;
+    case kMusic:
+        {
+            /* A minor triad over pink noise, with a slow envelope */
+            static const double freqs[] = { 220.0, 261.63, 329.63 };
+            double v = pink(channel) * 0.3
+                     * (0.6 + 0.4 * std::sin(2.0 * PI * 0.5 * t));
+            for (size_t i = 0; i < util::sizeof_array(freqs); ++i)
+                v += 0.12 * std::sin(2.0 * PI * freqs[i] * t + channel);
+            return v;
+        }
+    }
+    return 0.0;
+}
+
+double SignalSource::white()
+{
+    return static_cast<double>(m_rng()) / 2147483648.0 - 1.0;
+}
+
+/* Paul Kellet's refined pink noise filter */
+double SignalSource::pink(unsigned channel)
+{
+    double *b = &m_pink[channel * 7];
+    double w = white();
+    b[0] = 0.99886 * b[0] + w * 0.0555179;
+    b[1] = 0.99332 * b[1] + w * 0.0750759;
+    b[2] = 0.96900 * b[2] + w * 0.1538520;
+    b[3] = 0.86650 * b[3] + w * 0.3104856;
+    b[4] = 0.55000 * b[4] + w * 0.5329522;
+    b[5] = -0.7616 * b[5] - w * 0.0168980;
+    double v = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + w * 0.5362;
+    b[6] = w * 0.115926;
+    return v * 0.11;
+}
@@ -0,0 +1,51 @@
+#ifndef _SIGNALSOURCE_H
+#define _SIGNALSOURCE_H
+
+#include "iointer.h"
+#include "rng.h"
+
+/*
+ * Generates a test signal (--signal), for benchmarking the pipeline
+ * without depending on input files. Output is deterministic.
+ * PERIOD seconds of the signal are rendered once in the output format
+ * and repeated, so that reading costs no more than a copy and the
+ * benchmark measures the pipeline rather than the generator.
+ */
+class SignalSource: public ISeekableSource {
+public:
+    enum Type { kSilence, kSine, kNoise, kPink, kMusic };
+    /* also the period of the envelope of kMusic */
+    enum { PERIOD = 2 };
+private:
+    Type m_type;
+    uint64_t m_length;
+    int64_t m_position;
+    rng::Xor128 m_rng;
+    std::vector<double> m_pink; /* filter state, 7 per channel */
+    std::vector<uint8_t> m_table; /* rendered signal */
+    size_t m_period; /* length of m_table in frames */
+    AudioStreamBasicDescription m_asbd;
+public:
+    /* asbd: format as given by --raw-format, --raw-rate, --raw-channels */
+    SignalSource(Type type, const AudioStreamBasicDescription &asbd,
+                 uint64_t length);
+    static Type typeFromName(const std::wstring &name);
+
+    uint64_t length() const { return m_length; }
+    const AudioStreamBasicDescription &getSampleFormat() const
+    {
+        return m_asbd;
+    }
+    const std::vector<uint32_t> *getChannels() const { return 0; }
+    size_t readSamples(void *buffer, size_t nsamples);
+    bool isSeekable() { return true; }
+    void seekTo(int64_t count) { m_position = count; }
+    int64_t getPosition() { return m_position; }
+private:
+    void render();
+    double generate(int64_t n, unsigned channel);
+    double white();
+    double pink(unsigned channel);
+};
+
+#endif
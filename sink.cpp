@@ -134,7 +134,7 @@ MP4SinkBase::MP4SinkBase(const std::wstring &path, bool temp)
             char*, uint32_t, char **, uint32_t);
     if (temp) m_filename = L"qaac.int";
     try {
-        create = temp ? &MP4FileX::CreateTemp : &MP4FileX::Create;
+        create = temp ? &MP4FileX::CreateTemp : &MP4FileX::CreateX;
         (m_mp4file.*create)(
                     strutil::w2us(m_filename).c_str(),
                     0, // flags
@@ -154,6 +154,7 @@ void MP4SinkBase::close()
 {
     if (!m_closed) {
         m_closed = true;
+        m_muxer->finish();
         try {
             m_mp4file.Close();
         } catch (mp4v2::impl::Exception *e) {
@@ -193,6 +194,7 @@ MP4Sink::MP4Sink(const std::wstring &path,
     } catch (mp4v2::impl::Exception *e) {
         handle_mp4error(e);
     }
+    m_muxer = std::make_shared<MP4Muxer>(&m_mp4file, m_track_id);
 }
 
 ALACSink::ALACSink(const std::wstring &path,
@@ -212,6 +214,7 @@ ALACSink::ALACSink(const std::wstring &path,
     } catch (mp4v2::impl::Exception *e) {
         handle_mp4error(e);
     }
+    m_muxer = std::make_shared<MP4Muxer>(&m_mp4file, m_track_id);
 }
 
 ADTSSink::ADTSSink(const std::wstring &path, const std::vector<uint8_t> &cookie)
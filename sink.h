@@ -3,6 +3,7 @@
 
 #include "CoreAudioToolbox.h"
 #include "mp4v2wrapper.h"
+#include "mp4muxer.h"
 #include "itunetags.h"
 #include "iencoder.h"
 
@@ -10,11 +11,20 @@ class MP4SinkBase {
 protected:
     std::wstring m_filename;
     MP4FileX m_mp4file;
+    std::shared_ptr<MP4Muxer> m_muxer;
     MP4TrackId m_track_id;
     bool m_closed;
 public:
     MP4SinkBase(const std::wstring &path, bool temp=false);
-    MP4FileX *getFile() { return &m_mp4file; }
+    /*
+     * Samples still in the muxer queue are written out first.
+     * No more samples can be written after this.
+     */
+    MP4FileX *getFile()
+    {
+        m_muxer->finish();
+        return &m_mp4file;
+    }
     /* Don't automatically close, since close() involves finalizing */
     void close();
 };
@@ -27,14 +37,8 @@ public:
             uint32_t fcc, uint32_t trim=0, bool temp=false);
     void writeSamples(const void *data, size_t length, size_t nsamples)
     {
-        try {
-            if (++m_sample_id > m_trim) {
-                m_mp4file.WriteSample(m_track_id, (const uint8_t *)data,
-                                      length, MP4_INVALID_DURATION);
-            }
-        } catch (mp4v2::impl::Exception *e) {
-            handle_mp4error(e);
-        }
+        if (++m_sample_id > m_trim)
+            m_muxer->writeSample(data, length, MP4_INVALID_DURATION);
     }
 };
 
@@ -44,12 +48,7 @@ public:
              bool temp=false);
     void writeSamples(const void *data, size_t length, size_t nsamples)
     {
-        try {
-            m_mp4file.WriteSample(m_track_id, (const uint8_t *)data,
-                                  length, nsamples);
-        } catch (mp4v2::impl::Exception *e) {
-            handle_mp4error(e);
-        }
+        m_muxer->writeSample(data, length, nsamples);
     }
 };
 
@@ -1,9 +1,10 @@
 #include "soxresampler.h"
 #include "cautil.h"
+#include "counters.h"
 
 SoxrResampler::SoxrResampler(const SOXRModule &module,
                              const std::shared_ptr<ISource> &src,
-                             unsigned rate)
+                             unsigned rate, size_t block_samples)
     : FilterBase(src), m_module(module), m_position(0)
 {
     const AudioStreamBasicDescription &asbd = src->getSampleFormat();
@@ -32,7 +33,8 @@ SoxrResampler::SoxrResampler(const SOXRModule &module,
         throw std::runtime_error(strutil::format("soxr: %s",
                                                  soxr_strerror(error)));
     m_resampler = std::shared_ptr<soxr>(resampler, m_module.delete_);
-    m_module.set_input_fn(resampler, staticInputProc, this, 0x10000);
+    m_module.set_input_fn(resampler, staticInputProc, this, block_samples);
+    m_buffer.resize(block_samples * m_asbd.mBytesPerFrame);
     double factor = rate / asbd.mSampleRate;
     m_length = source()->length();
     if (m_length != ~0ULL)
@@ -41,6 +43,7 @@ SoxrResampler::SoxrResampler(const SOXRModule &module,
 
 size_t SoxrResampler::readSamples(void *buffer, size_t nsamples)
 {
+    TRACE_SPAN("soxr.readSamples");
     size_t odone = m_module.output(m_resampler.get(), buffer, nsamples);
     m_position += odone;
     return odone;
@@ -48,6 +51,7 @@ size_t SoxrResampler::readSamples(void *buffer, size_t nsamples)
 
 size_t SoxrResampler::inputProc(soxr_in_t *data, size_t nsamples)
 {
+    HISTOGRAM_LOG2("soxr.inputProc.nsamples", nsamples);
     if (m_buffer.size() < nsamples * m_asbd.mBytesPerFrame)
         m_buffer.resize(nsamples * m_asbd.mBytesPerFrame);
     if (m_asbd.mBitsPerChannel == 32)
@@ -13,8 +13,9 @@ class SoxrResampler: public FilterBase {
     AudioStreamBasicDescription m_asbd;
     SOXRModule m_module;
 public:
+    /* block_samples: maximum number of input frames pulled at once */
     SoxrResampler(const SOXRModule &module, const std::shared_ptr<ISource> &src,
-                  unsigned rate);
+                  unsigned rate, size_t block_samples=0x10000);
     uint64_t length() const
     {
         return m_length;
@@ -123,6 +123,21 @@ namespace strutil {
     }
 #endif
 
+    std::wstring json_escape(const std::wstring &s)
+    {
+        std::wstring result;
+        for (size_t i = 0; i < s.size(); ++i) {
+            wchar_t c = s[i];
+            if (c == L'"' || c == L'\\')
+                result.push_back(L'\\');
+            if (c < 0x20)
+                result += format(L"\\u%04x", c);
+            else
+                result.push_back(c);
+        }
+        return result;
+    }
+
     /*
      * NUMBER ::= [0-9]+
      * TERM ::= NUMBER | NUMBER"-"NUMBER
@@ -111,6 +111,9 @@ namespace strutil {
     std::string format(const char *fmt, ...);
     std::wstring format(const wchar_t *fmt, ...);
 
+    /* escapes s for use inside a JSON string literal */
+    std::wstring json_escape(const std::wstring &s);
+
     template <typename T>
     std::basic_string<T> normalize_crlf(const T *s, const T *eol)
     {
@@ -188,6 +188,20 @@ namespace util {
         return 20 * std::log10(scale);
     }
 
+    const uint64_t FNV1A_INIT = 0xcbf29ce484222325ULL;
+
+    /* 64bit FNV-1a; start with *hash = FNV1A_INIT */
+    inline void fnv1a(uint64_t *hash, const void *data, size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t*>(data);
+        uint64_t h = *hash;
+        for (size_t i = 0; i < size; ++i) {
+            h ^= p[i];
+            h *= 0x100000001b3ULL;
+        }
+        *hash = h;
+    }
+
 }
 
 #define CHECKCRT(expr) \
@@ -21,17 +21,19 @@ namespace wave {
 }
 
 WaveSource::WaveSource(const std::shared_ptr<FILE> &fp, bool ignorelength)
-    : m_data_pos(0), m_position(0), m_fp(fp)
+    : m_data_pos(0), m_position(0), m_fp(fp), m_ipos(0), m_iend(0)
 {
     std::memset(&m_asbd, 0, sizeof m_asbd);
     m_seekable = util::is_seekable(fileno(m_fp.get()));
+    m_ibuf.resize(0x40000);
     int64_t data_length = parse();
     if (ignorelength || !data_length || data_length % m_block_align)
         m_length = ~0ULL;
     else
         m_length = data_length / m_block_align;
     if (m_seekable) {
-        m_data_pos = _lseeki64(fd(), 0, SEEK_CUR);
+        m_data_pos = _lseeki64(fd(), 0, SEEK_CUR)
+                   - static_cast<int64_t>(m_iend - m_ipos);
         if (m_length == ~0ULL)
             m_length = (_filelengthi64(fd()) - m_data_pos) / m_block_align;
     }
@@ -43,11 +45,11 @@ size_t WaveSource::readSamples(void *buffer, size_t nsamples)
         nsamples = static_cast<size_t>(std::min(static_cast<uint64_t>(nsamples),
                                                 m_length - m_position));
     }
-    ssize_t nbytes = nsamples * m_block_align;
+    size_t nbytes = nsamples * m_block_align;
     if (m_buffer.size() < nbytes)
         m_buffer.resize(nbytes);
-    nbytes = util::nread(fd(), &m_buffer[0], nbytes);
-    nsamples = nbytes > 0 ? nbytes / m_block_align: 0;
+    nbytes = read(&m_buffer[0], nbytes);
+    nsamples = nbytes / m_block_align;
     if (nsamples) {
         size_t size = nsamples * m_block_align;
         util::unpack(&m_buffer[0], buffer, &size,
@@ -67,23 +69,71 @@ void WaveSource::seekTo(int64_t count)
     if (m_seekable) {
         CHECKCRT(_lseeki64(fd(), m_data_pos + count * m_block_align,
                            SEEK_SET) < 0);
+        m_ipos = m_iend = 0;
         m_position = count;
     }
     else if (m_position > count)
         throw std::runtime_error("Cannot seek back the input");
     else {
-        char buf[0x1000];
-        int64_t nread = 0;
         int64_t bytes = (count - m_position) * m_block_align;
-        while (nread < bytes) {
-            int n = util::nread(fd(), buf, std::min(bytes - nread, 0x1000LL));
-            if (n < 0) break;
-            nread += n;
-        }
-        m_position += nread / m_block_align;
+        m_position += discard(bytes) / m_block_align;
     }
 }
 
+/*
+ * Reads through m_ibuf, so that small reads of chunk headers don't turn
+ * into syscalls. Large reads go directly to the destination.
+ */
+size_t WaveSource::read(void *buffer, size_t size)
+{
+    uint8_t *bp = static_cast<uint8_t*>(buffer);
+    size_t total = std::min(size, m_iend - m_ipos);
+    std::memcpy(bp, &m_ibuf[m_ipos], total);
+    m_ipos += total;
+    if (total == size)
+        return total;
+    ssize_t n;
+    if (size - total >= m_ibuf.size()) {
+        n = util::nread(fd(), bp + total, size - total);
+        return n > 0 ? total + n : total;
+    }
+    /*
+     * Refill with single read() calls, taking whatever is available.
+     * Waiting for the whole buffer would stall on a slow pipe.
+     */
+    while (total < size) {
+        n = _read(fd(), &m_ibuf[0], m_ibuf.size());
+        if (n <= 0)
+            break;
+        m_iend = n;
+        size_t count = std::min(size - total, m_iend);
+        std::memcpy(bp + total, &m_ibuf[0], count);
+        m_ipos = count;
+        total += count;
+    }
+    return total;
+}
+
+/* skips forward without seeking, returns number of bytes skipped */
+int64_t WaveSource::discard(int64_t size)
+{
+    int64_t total = std::min(static_cast<int64_t>(m_iend - m_ipos), size);
+    m_ipos += static_cast<size_t>(total);
+    if (total == size)
+        return total;
+    /* buffer is drained; pipes can't skip, read in large blocks */
+    m_ipos = m_iend = 0;
+    while (total < size) {
+        size_t count = static_cast<size_t>(
+                std::min(size - total, static_cast<int64_t>(m_ibuf.size())));
+        ssize_t n = util::nread(fd(), &m_ibuf[0], count);
+        if (n <= 0)
+            break;
+        total += n;
+    }
+    return total;
+}
+
 int64_t WaveSource::parse()
 {
     int64_t data_length = 0;
@@ -107,39 +157,41 @@ int64_t WaveSource::parse()
 
     while (nextChunk(&size) != FOURCCR('d','a','t','a'))
         skip((size + 1) & ~1);
+    /*
+     * 0xffffffff is what streaming writers put when the size is unknown;
+     * treat as ignorelength, otherwise reading stops at 4GB.
+     */
     if (fcc != FOURCCR('R','F','6','4'))
-        data_length = size;
+        data_length = size == 0xffffffff ? 0 : size;
 
     return data_length;
 }
 
 inline void WaveSource::read16le(void *n)
 {
-    util::check_eof(util::nread(fd(), n, 2) == 2);
+    util::check_eof(read(n, 2) == 2);
 }
 
 inline void WaveSource::read32le(void *n)
 {
-    util::check_eof(util::nread(fd(), n, 4) == 4);
+    util::check_eof(read(n, 4) == 4);
 }
 
 inline void WaveSource::read64le(void *n)
 {
-    util::check_eof(util::nread(fd(), n, 8) == 8);
+    util::check_eof(read(n, 8) == 8);
 }
 
 void WaveSource::skip(int64_t n)
 {
-    if (m_seekable)
-        CHECKCRT(_lseeki64(fd(), n, SEEK_CUR) < 0);
-    else {
-        char buf[8192];
-        while (n > 0) {
-            int nn = static_cast<int>(std::min(n, 8192LL));
-            util::check_eof(util::nread(fd(), buf, nn) == nn);
-            n -= nn;
-        }
-    }
+    int64_t buffered = m_iend - m_ipos;
+    if (n <= buffered)
+        m_ipos += static_cast<size_t>(n);
+    else if (m_seekable) {
+        CHECKCRT(_lseeki64(fd(), n - buffered, SEEK_CUR) < 0);
+        m_ipos = m_iend = 0;
+    } else
+        util::check_eof(discard(n) == n);
 }
 
 uint32_t WaveSource::nextChunk(uint32_t *size)
@@ -213,7 +265,7 @@ void WaveSource::fmt(size_t size)
         if (dwChannelMask > 0 && util::bitcount(dwChannelMask) >= nChannels)
             chanmap::getChannels(dwChannelMask, &m_chanmap, nChannels);
 
-        util::check_eof(util::nread(fd(), &guid, sizeof guid) == sizeof guid);
+        util::check_eof(read(&guid, sizeof guid) == sizeof guid);
         skip((size - 39) & ~1);
 
         if (!std::memcmp(&guid, &wave::ksFormatSubTypeFloat, sizeof guid))
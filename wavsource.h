@@ -24,6 +24,10 @@ class WaveSource: public ISeekableSource {
     std::shared_ptr<FILE> m_fp;
     std::vector<uint32_t> m_chanmap;
     std::vector<uint8_t> m_buffer;
+    /* read buffer, m_ibuf[m_ipos..m_iend] is not consumed yet */
+    std::vector<uint8_t> m_ibuf;
+    size_t m_ipos;
+    size_t m_iend;
     AudioStreamBasicDescription m_asbd;
 public:
     WaveSource(const std::shared_ptr<FILE> &fp, bool ignorelength = false);
@@ -42,6 +46,8 @@ public:
     void seekTo(int64_t count);
 private:
     int fd() { return fileno(m_fp.get()); }
+    size_t read(void *buffer, size_t size);
+    int64_t discard(int64_t size);
     int64_t parse();
     void read16le(void *n);
     void read32le(void *n);
@@ -19,6 +19,7 @@ bool WICConvertArtwork(const void *data, size_t size, unsigned maxSize,
 #include "util.h"
 #include "win32util.h"
 #include "wicimage.h"
+#include "imagescale.h"
 
 _COM_SMARTPTR_TYPEDEF(IStream, __uuidof(IStream));
 _COM_SMARTPTR_TYPEDEF(IPropertyBag2, __uuidof(IPropertyBag2));
@@ -28,7 +29,7 @@ _COM_SMARTPTR_TYPEDEF(IWICBitmap, __uuidof(IWICBitmap));
 _COM_SMARTPTR_TYPEDEF(IWICBitmapDecoder, __uuidof(IWICBitmapDecoder));
 _COM_SMARTPTR_TYPEDEF(IWICBitmapFrameDecode, __uuidof(IWICBitmapFrameDecode));
 _COM_SMARTPTR_TYPEDEF(IWICBitmapSource, __uuidof(IWICBitmapSource));
-_COM_SMARTPTR_TYPEDEF(IWICBitmapScaler, __uuidof(IWICBitmapScaler));
+_COM_SMARTPTR_TYPEDEF(IWICFormatConverter, __uuidof(IWICFormatConverter));
 _COM_SMARTPTR_TYPEDEF(IWICBitmapEncoder, __uuidof(IWICBitmapEncoder));
 _COM_SMARTPTR_TYPEDEF(IWICBitmapFrameEncode, __uuidof(IWICBitmapFrameEncode));
 
@@ -86,10 +87,29 @@ bool WICConvertArtwork(const void *data, size_t size, unsigned maxSize,
     UINT newWidth = static_cast<UINT>(width * scale),
          newHeight = static_cast<UINT>(height * scale);
 
-    IWICBitmapScalerPtr scaler;
-    HR(factory->CreateBitmapScaler(&scaler));
-    HR(scaler->Initialize(source, newWidth, newHeight,
-                WICBitmapInterpolationModeFant));
+    /*
+     * Scale by ourselves on 24bit BGR pixels (JPEG has no alpha anyway),
+     * WIC is only used for decoding and encoding.
+     */
+    IWICFormatConverterPtr converter;
+    HR(factory->CreateFormatConverter(&converter));
+    HR(converter->Initialize(source, GUID_WICPixelFormat24bppBGR,
+                WICBitmapDitherTypeNone, 0, 0.0,
+                WICBitmapPaletteTypeCustom));
+    UINT stride = width * 3;
+    std::vector<uint8_t> pixels(stride * height);
+    HR(converter->CopyPixels(0, stride, pixels.size(), &pixels[0]));
+
+    UINT newStride = newWidth * 3;
+    std::vector<uint8_t> scaled(newStride * newHeight);
+    imagescale::resize(&pixels[0], width, height, stride, 3,
+                       &scaled[0], newWidth, newHeight, newStride);
+    std::vector<uint8_t>().swap(pixels);
+
+    IWICBitmapPtr bitmap;
+    HR(factory->CreateBitmapFromMemory(newWidth, newHeight,
+                GUID_WICPixelFormat24bppBGR, newStride, scaled.size(),
+                &scaled[0], &bitmap));
 
     IStreamPtr ostream;
     HR(CreateStreamOnHGlobal(0, TRUE, &ostream));
@@ -104,7 +124,7 @@ bool WICConvertArtwork(const void *data, size_t size, unsigned maxSize,
 
     SetJpegEncodingQuality(props, 0.95f);
     HR(sink->Initialize(props));
-    HR(sink->WriteSource(scaler, 0));
+    HR(sink->WriteSource(bitmap, 0));
     HR(sink->Commit());
     HR(encoder->Commit());
 
@@ -117,5 +117,36 @@ namespace win32 {
     char *load_with_mmap(const wchar_t *path, uint64_t *size);
 
     int create_named_pipe(const wchar_t *path);
+
+    class CriticalSection {
+        CRITICAL_SECTION m_cs;
+    public:
+        CriticalSection() { InitializeCriticalSection(&m_cs); }
+        ~CriticalSection() { DeleteCriticalSection(&m_cs); }
+        void enter() { EnterCriticalSection(&m_cs); }
+        bool tryEnter() { return TryEnterCriticalSection(&m_cs) != 0; }
+        void leave() { LeaveCriticalSection(&m_cs); }
+    private:
+        CriticalSection(const CriticalSection&);
+        CriticalSection& operator=(const CriticalSection&);
+    };
+
+    class Lock {
+        CriticalSection &m_cs;
+    public:
+        explicit Lock(CriticalSection &cs): m_cs(cs) { m_cs.enter(); }
+        ~Lock() { m_cs.leave(); }
+    private:
+        Lock(const Lock&);
+        Lock& operator=(const Lock&);
+    };
+
+    /* auto-reset event */
+    inline std::shared_ptr<void> create_event()
+    {
+        HANDLE h = CreateEventW(0, 0, 0, 0);
+        if (!h) throw_error("CreateEvent", GetLastError());
+        return std::shared_ptr<void>(h, CloseHandle);
+    }
 }
 #endif